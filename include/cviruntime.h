@@ -67,6 +67,30 @@ typedef enum {
    * set program id, for switch programs in cvimodel
    */
   OPTION_PROGRAM_INDEX            = 9,
+  /*
+   * bool, default value is false,
+   * if set to true, runtime loads a second instance of the program
+   * and pipelines requests submitted by ForwardAsync, tpu routines of
+   * next request run while cpu routines of current one are running.
+   * Results are delivered in submission order, outputs of a request are
+   * written when it's waited or before its callback, so requests in
+   * flight can share output tensors. It falls back to normal
+   * mode if the program has no trailing cpu routines that can be
+   * overlapped safely.
+   */
+  OPTION_ENABLE_PIPELINE          = 10,
+  /*
+   * bool, default value is false,
+   * if set to true, all programs of cvimodel are loaded into the
+   * handle when getting tensors, and share one private activation
+   * memory sized to the largest program. OPTION_PROGRAM_INDEX then
+   * switches default program of Forward APIs, or use ForwardProgram
+   * to select one per call. Exported tensors in private memory get
+   * host buffers, as the memory is rewritten by other programs.
+   * Programs of the handle must not run concurrently, clone the
+   * model to run them in parallel.
+   */
+  OPTION_MULTI_PROGRAM            = 11,
   // DEPRECATED
   OPTION_BATCH_SIZE               = 1,
   // DEPRECATED
@@ -122,6 +146,38 @@ typedef struct {
 
 typedef void *CVI_MODEL_HANDLE;
 
+typedef enum {
+  CVI_LOAD_PHASE_PARSE = 0,      // header and model description
+  CVI_LOAD_PHASE_CUSTOM_FUNC,    // custom cpu function sections
+  CVI_LOAD_PHASE_WEIGHT,         // weight section
+  CVI_LOAD_PHASE_CMDBUF,         // cmdbuf and dmabuf sections
+  CVI_LOAD_PHASE_DECOMPRESS,     // lz4 decompression of sections
+  CVI_LOAD_PHASE_CPU_WEIGHT_MAP, // weight tensors of cpu functions
+  CVI_LOAD_PHASE_PROGRAM,        // program loading, includes the two below
+  CVI_LOAD_PHASE_NEURON_MAP,     // neuron map of program
+  CVI_LOAD_PHASE_CPU_FUNC_SETUP, // setup of cpu functions in program
+  CVI_LOAD_PHASE_NUM
+} CVI_LOAD_PHASE_E;
+
+typedef struct {
+  uint64_t time_us;
+  uint64_t bytes;
+} CVI_LOAD_PHASE_STAT;
+
+typedef struct {
+  char name[64];
+  int32_t type;          // section type in cvimodel
+  uint64_t size;         // bytes stored in cvimodel
+  uint64_t loaded_size;  // bytes after decompression
+  uint64_t time_us;
+} CVI_LOAD_SECTION_STAT;
+
+typedef struct {
+  uint64_t total_us;
+  CVI_LOAD_PHASE_STAT phases[CVI_LOAD_PHASE_NUM];
+  int32_t section_num;
+} CVI_LOAD_STATS;
+
 typedef int CVI_RC;
 /*
  * Register a cvimodel file to runtime, and return a model handle.
@@ -130,6 +186,34 @@ typedef int CVI_RC;
  */
 CVI_RC CVI_NN_RegisterModel(const char *model_file, CVI_MODEL_HANDLE *model);
 
+/*
+ * Flags of CVI_NN_RegisterModelWithFlags.
+ * CVI_NN_REGISTER_MMAP: map the cvimodel file instead of reading it to heap,
+ *   the model description is parsed in place from the mapping. It can also
+ *   be enabled for CVI_NN_RegisterModel by env TPU_ENABLE_MMAP=1.
+ * CVI_NN_REGISTER_NO_CACHE: always load a new copy of the model. By default
+ *   registering a cvimodel which is already registered (same file, fd or
+ *   buffer content) shares weight and cmdbuf with it, like CVI_NN_CloneModel.
+ *   The cache can be disabled globally by env TPU_DISABLE_MODEL_CACHE=1.
+ * CVI_NN_REGISTER_EAGER: load cmdbuf of all programs at registration. By
+ *   default, for cvimodel file with several programs, cmdbuf of a program is
+ *   loaded when it's selected and released when no instance uses it.
+ */
+typedef enum {
+  CVI_NN_REGISTER_MMAP = 0x1,
+  CVI_NN_REGISTER_NO_CACHE = 0x2,
+  CVI_NN_REGISTER_EAGER = 0x4,
+} CVI_NN_REGISTER_FLAG_E;
+
+/*
+ * Register a cvimodel file to runtime with flags, and return a model handle.
+ * @param [in] model_file,     file name of cvimodel.
+ * @param [in] flags,          bitwise OR of CVI_NN_REGISTER_FLAG_E.
+ * @param [out] model,         handle to registered model.
+ */
+CVI_RC CVI_NN_RegisterModelWithFlags(const char *model_file, uint32_t flags,
+                                     CVI_MODEL_HANDLE *model);
+
 /*
  * Register a cvimodel file from memory, and return a model handle.
  * @param [in] buf,            buffer to store cvimodel data.
@@ -140,6 +224,48 @@ CVI_RC CVI_NN_RegisterModelFromBuffer(const int8_t *buf, uint32_t size, CVI_MODE
 
 CVI_RC CVI_NN_RegisterModelFromFd(const int fd, const size_t ud_offset, CVI_MODEL_HANDLE *model);
 
+/*
+ * Register a cvimodel from memory or fd with flags. Only
+ * CVI_NN_REGISTER_NO_CACHE applies to them, other flags are ignored.
+ */
+CVI_RC CVI_NN_RegisterModelFromBufferWithFlags(const int8_t *buf, uint32_t size,
+                                               uint32_t flags, CVI_MODEL_HANDLE *model);
+CVI_RC CVI_NN_RegisterModelFromFdWithFlags(const int fd, const size_t ud_offset,
+                                           uint32_t flags, CVI_MODEL_HANDLE *model);
+
+typedef void *CVI_REGISTER_HANDLE;
+
+/*
+ * Start registering a cvimodel on a background thread, and return a
+ * handle to get the model by CVI_NN_RegisterModelWait/Poll. Several models
+ * registered asynchronously are loaded concurrently. The buffer or fd
+ * must be kept valid until the registration is finished. They share
+ * cached models unless disabled by env TPU_DISABLE_MODEL_CACHE=1.
+ * @param [in] model_file,     file name of cvimodel.
+ * @param [out] handle,        handle of the registration.
+ */
+CVI_RC CVI_NN_RegisterModelAsync(const char *model_file, CVI_REGISTER_HANDLE *handle);
+CVI_RC CVI_NN_RegisterModelFromBufferAsync(const int8_t *buf, uint32_t size,
+                                           CVI_REGISTER_HANDLE *handle);
+CVI_RC CVI_NN_RegisterModelFromFdAsync(const int fd, const size_t ud_offset,
+                                       CVI_REGISTER_HANDLE *handle);
+
+/*
+ * Wait for an asynchronous registration, the handle is released.
+ * @param [in] handle,         handle of the registration.
+ * @param [out] model,         handle to registered model.
+ * @return result of the registration.
+ */
+CVI_RC CVI_NN_RegisterModelWait(CVI_REGISTER_HANDLE handle, CVI_MODEL_HANDLE *model);
+
+/*
+ * Check an asynchronous registration without blocking. Return CVI_RC_AGAIN
+ * if it's not finished yet, otherwise same as CVI_NN_RegisterModelWait.
+ * @param [in] handle,         handle of the registration.
+ * @param [out] model,         handle to registered model.
+ */
+CVI_RC CVI_NN_RegisterModelPoll(CVI_REGISTER_HANDLE handle, CVI_MODEL_HANDLE *model);
+
 /*
  * Clone model that pointed by previous model handle, it will increment
  * the refence count of model. The returned handle will share resources with
@@ -149,6 +275,22 @@ CVI_RC CVI_NN_RegisterModelFromFd(const int fd, const size_t ud_offset, CVI_MODE
  */
 CVI_RC CVI_NN_CloneModel(CVI_MODEL_HANDLE model, CVI_MODEL_HANDLE *cloned);
 
+/*
+ * Get time and bytes spent on loading the model. Sections are loaded
+ * concurrently, so phase times are summed over threads and may exceed
+ * total_us, which is the wall time of registration and program loading.
+ * Decompression is counted in its own phase only, not in the phase of
+ * the section. Registration is shared by clones and cached handles,
+ * program phases only count the programs of this handle, after
+ * CVI_NN_GetInputOutputTensors.
+ * @param [in] model,            handle of model.
+ * @param [out] stats,           time and bytes of each phase.
+ * @param [out] sections,        per section records, can be NULL.
+ * @param [in] max_section_num,  capacity of sections.
+ */
+CVI_RC CVI_NN_GetLoadStats(CVI_MODEL_HANDLE model, CVI_LOAD_STATS *stats,
+                           CVI_LOAD_SECTION_STAT *sections, int32_t max_section_num);
+
 /*
  * Get version number of cvimodel.
  * @param [in] model,  previous handle of model
@@ -164,6 +306,15 @@ CVI_RC CVI_NN_GetModelVersion(CVI_MODEL_HANDLE model, int32_t *major, int32_t *m
  */
 const char * CVI_NN_GetModelTarget(CVI_MODEL_HANDLE model);
 
+/*
+ * Get the runtime context (CVI_RT_HANDLE) the model is registered on,
+ * device memory of frames fed to the model can be allocated from it.
+ * It's owned by runtime and valid until the model is cleaned up.
+ * @param [in] model,  handle of model
+ * @param [out] ctx,   the context
+ */
+CVI_RC CVI_NN_GetModelContext(CVI_MODEL_HANDLE model, void **ctx);
+
 /*
  * To set the configuration that specified by CVI_CONFIG_OPTION.
  * This API must to be called before GetInputOutputTensors if user
@@ -186,8 +337,45 @@ CVI_RC CVI_NN_SetConfig(CVI_MODEL_HANDLE model, CVI_CONFIG_OPTION option, ...);
  */
 CVI_RC CVI_NN_GetInputOutputTensors(CVI_MODEL_HANDLE model, CVI_TENSOR **inputs,
     int32_t *input_num, CVI_TENSOR **outputs, int32_t *output_num);
+/*
+ * Get input and output tensors of one program, the handle must be
+ * set with OPTION_MULTI_PROGRAM, and CVI_NN_GetInputOutputTensors
+ * must be called before to load programs.
+ * @param [in] model,         handle of model.
+ * @param [in] program_id,    index of program.
+ * @param [out] inputs,       array of input tensors.
+ * @param [out] input_num,    number of input tensors.
+ * @param [out] outputs,      array of output tensors.
+ * @param [out] output_num,   number of output tensors.
+ */
+CVI_RC CVI_NN_GetProgramInputOutputTensors(CVI_MODEL_HANDLE model, int32_t program_id,
+    CVI_TENSOR **inputs, int32_t *input_num, CVI_TENSOR **outputs, int32_t *output_num);
+
+/*
+ * Find the program whose inputs hold given shapes with least elements,
+ * for handle set with OPTION_MULTI_PROGRAM.
+ * @param [in] model,         handle of model.
+ * @param [in] shapes,        shapes of inputs.
+ * @param [in] input_num,     number of inputs.
+ * @param [out] program_id,   index of program, CVI_RC_DATA_ERR if none fits.
+ */
+CVI_RC CVI_NN_SelectProgram(CVI_MODEL_HANDLE model, const CVI_SHAPE shapes[],
+    int32_t input_num, int32_t *program_id);
+
+/*
+ * Inference forwarding of one program in blocking mode, for handle
+ * set with OPTION_MULTI_PROGRAM. If program_id is negative, program
+ * is selected by shapes of inputs as CVI_NN_SelectProgram does.
+ * Tensors are usually the ones of the program, see
+ * CVI_NN_GetProgramInputOutputTensors.
+ */
+CVI_RC CVI_NN_ForwardProgram(CVI_MODEL_HANDLE model, int32_t program_id,
+    CVI_TENSOR inputs[], int32_t input_num, CVI_TENSOR outputs[], int32_t output_num);
+
 /*
  * Inference forwarding in blocking mode.
+ * For inputs in system memory, only the first mem_size bytes are
+ * transferred if mem_size is less than the size of tensor.
  */
 CVI_RC CVI_NN_Forward(CVI_MODEL_HANDLE model, CVI_TENSOR inputs[], int32_t input_num,
     CVI_TENSOR outputs[], int32_t output_num);
@@ -201,6 +389,131 @@ CVI_RC CVI_NN_ForwardAsync(CVI_MODEL_HANDLE model, CVI_TENSOR inputs[], int32_t
  * Waiting result after do inference forward in async mode.
  */
 CVI_RC CVI_NN_ForwardWait(CVI_MODEL_HANDLE model, void *task_no);
+/*
+ * Check result of inference forward in async mode without blocking.
+ * @param [in] model,    handle of model
+ * @param [in] task_no,  task returned by ForwardAsync
+ * @retval CVI_RC_AGAIN if the task is not done yet, otherwise
+ *         result of the task, and task_no is released.
+ */
+CVI_RC CVI_NN_ForwardPoll(CVI_MODEL_HANDLE model, void *task_no);
+/*
+ * Get bytes of cache flushed and invalidated by runtime in last
+ * inference of model handle, for profiling.
+ */
+CVI_RC CVI_NN_GetCacheStats(CVI_MODEL_HANDLE model, uint64_t *flushed_bytes,
+    uint64_t *invalidated_bytes);
+/*
+ * Get an eventfd which becomes readable when an async task of the
+ * model handle is done, it can be added to poll/epoll set. Reading it
+ * returns the number of tasks done since last read, then use ForwardPoll
+ * to fetch results. Only tasks submitted after the fd is created are
+ * signalled, including those of ForwardAsyncWithCallback, whose fd is
+ * signalled after the callback returns. The fd is owned by runtime and
+ * closed in CleanupModel.
+ * @param [in] model,  handle of model
+ * @param [out] fd,    the eventfd
+ */
+CVI_RC CVI_NN_GetCompletionFd(CVI_MODEL_HANDLE model, int32_t *fd);
+/*
+ * Callback of ForwardAsyncWithCallback, it's invoked in worker
+ * thread of runtime once the inference is done, so it should
+ * return quickly.
+ * @param [in] model,      handle of model
+ * @param [in] ret,        result of inference
+ * @param [in] user_data,  user_data passed to ForwardAsyncWithCallback
+ */
+typedef void (*CVI_NN_FORWARD_CALLBACK)(CVI_MODEL_HANDLE model, CVI_RC ret,
+                                        void *user_data);
+/*
+ * Infernece forwarding in asynchronous mode, callback is invoked
+ * after the inference is done. No need to call ForwardWait.
+ * @param [in] callback,   callback to be invoked
+ * @param [in] user_data,  user data passed to callback
+ */
+CVI_RC CVI_NN_ForwardAsyncWithCallback(CVI_MODEL_HANDLE model, CVI_TENSOR inputs[],
+    int32_t input_num, CVI_TENSOR outputs[], int32_t output_num,
+    CVI_NN_FORWARD_CALLBACK callback, void *user_data);
+/*
+ * Create a dynamic batching front-end of model. Single sample requests
+ * submitted by BatcherForward from many threads are coalesced into the
+ * largest batch program of the model (e.g. compiled with batch 1, 4 and 8)
+ * that can be filled within max_delay_us, outputs are scattered back
+ * to the callers. Programs whose tensors are not batched in dim 0 are
+ * ignored.
+ * @param [in] model,         handle of model
+ * @param [in] max_delay_us,  max time the oldest request waits for
+ *                            others to fill a batch
+ * @param [out] batcher,      handle of batcher
+ */
+typedef void *CVI_BATCHER_HANDLE;
+CVI_RC CVI_NN_CreateBatcher(CVI_MODEL_HANDLE model, int32_t max_delay_us,
+    CVI_BATCHER_HANDLE *batcher);
+/*
+ * Inference one sample by batcher in blocking mode. Tensors must be
+ * in system memory, and each holds one sample, i.e. mem_size / dim[0]
+ * bytes of the corresponding tensor of model.
+ */
+CVI_RC CVI_NN_BatcherForward(CVI_BATCHER_HANDLE batcher, CVI_TENSOR inputs[],
+    int32_t input_num, CVI_TENSOR outputs[], int32_t output_num);
+/*
+ * Destroy batcher, all callers of BatcherForward should have returned.
+ */
+CVI_RC CVI_NN_DestroyBatcher(CVI_BATCHER_HANDLE batcher);
+/*
+ * JIT the tdma cmdbufs used to feed frames into input tensors of model,
+ * so that the first frame doesn't pay for it. Cmdbufs are cached
+ * process-wide, models with identically shaped inputs share them.
+ */
+CVI_RC CVI_NN_Warmup(CVI_MODEL_HANDLE model);
+/*
+ * Chain output tensor of src model to input tensor of dst model in
+ * device memory, so that dst model reads the output in place without
+ * copy. Output must be produced by tpu in io memory, and input must not
+ * be consumed by cpu routines, otherwise CVI_RC_UNSUPPORT is returned.
+ * src model must not be cleaned up before dst model.
+ * @param [in] src_model,    handle of model producing the tensor
+ * @param [in] output_name,  name of output tensor of src model
+ * @param [in] dst_model,    handle of model consuming the tensor
+ * @param [in] input_name,   name of input tensor of dst model
+ */
+CVI_RC CVI_NN_ChainTensor(CVI_MODEL_HANDLE src_model, const char *output_name,
+    CVI_MODEL_HANDLE dst_model, const char *input_name);
+/*
+ * Create a graph of models, in which each model is a node and each edge
+ * connects an output of a model to an input of another. Models with no
+ * dependencies between them can run concurrently.
+ * @param [out] graph,  handle of graph
+ */
+typedef void *CVI_GRAPH_HANDLE;
+CVI_RC CVI_NN_CreateGraph(CVI_GRAPH_HANDLE *graph);
+/*
+ * Add model to graph as a node, it runs with its own input and
+ * output tensors returned by CVI_NN_GetInputOutputTensors.
+ * @param [in] graph,      handle of graph
+ * @param [in] model,      handle of model
+ * @param [out] node_id,   id of node
+ */
+CVI_RC CVI_NN_GraphAddModel(CVI_GRAPH_HANDLE graph, CVI_MODEL_HANDLE model,
+    int32_t *node_id);
+/*
+ * Add edge from output of src node to input of dst node. The tensor is
+ * chained in device memory if possible, or copied by host after src node
+ * runs. If names are NULL, only the order of execution is constrained.
+ */
+CVI_RC CVI_NN_GraphAddEdge(CVI_GRAPH_HANDLE graph, int32_t src_node,
+    const char *output_name, int32_t dst_node, const char *input_name);
+/*
+ * Run all nodes of graph in dependency order. With parallel set, the
+ * independent nodes run on different threads, which requires the shared
+ * memory pool of CVI_NN_Global_SetSharedMemorySlotNum, or graph runs
+ * serially.
+ */
+CVI_RC CVI_NN_GraphRun(CVI_GRAPH_HANDLE graph, int32_t parallel);
+/*
+ * Destroy graph, models added to it are not cleaned up.
+ */
+CVI_RC CVI_NN_DestroyGraph(CVI_GRAPH_HANDLE graph);
 /*
  * Decrement of the reference count of model.
  * It will cleanup all resources of model if reference
@@ -264,6 +577,39 @@ CVI_RC CVI_NN_SetTensorPtr(CVI_TENSOR *tensor, void *mem);
  */
 CVI_RC CVI_NN_SetTensorPhysicalAddr(CVI_TENSOR *tensor, uint64_t paddr);
 
+/*
+ * Bind an output tensor to user's device buffer, tpu writes the output
+ * into it directly and Forward skips copying it out. The tensor is updated
+ * to point to the buffer. Only outputs in io mem, which are not consumed
+ * by cpu routines of the model, can be bound. Runtime doesn't flush or
+ * invalidate the buffer, caller should invalidate it before reading by
+ * cpu if it's mapped cached.
+ * @param [in] model,   handle of model
+ * @param [in] tensor,  output tensor got by GetInputOutputTensors
+ * @param [in] paddr,   physical address of buffer, at least mem_size of tensor
+ * @param [in] vaddr,   virtual address of buffer
+ */
+CVI_RC CVI_NN_BindOutputBuffer(CVI_MODEL_HANDLE model, CVI_TENSOR *tensor,
+    uint64_t paddr, void *vaddr);
+
+/*
+ * Keep an output in device memory as the input of next forward, for
+ * recurrent state or kv cache. Io mem of the two tensors is swapped
+ * after each forward instead of copied. The input is loaded from caller
+ * on first forward and after CVI_NN_ResetState, the output is never
+ * copied to caller. Both tensors must be in io mem of their own.
+ * @param [in] model,        handle of model.
+ * @param [in] output_name,  name of output tensor.
+ * @param [in] input_name,   name of input tensor.
+ */
+CVI_RC CVI_NN_BindStateTensor(CVI_MODEL_HANDLE model, const char *output_name,
+    const char *input_name);
+
+/*
+ * Load state inputs from caller again on next forward.
+ */
+CVI_RC CVI_NN_ResetState(CVI_MODEL_HANDLE model);
+
 /*
  * Do data copy from video frame to tensor
  * WARNNING, this API is DEPRECATED.
@@ -294,6 +640,33 @@ CVI_RC CVI_NN_SetTensorWithAlignedFrames(
  */
 void CVI_NN_Global_SetSharedMemorySize(size_t size);
 
+/*
+ * set number of shared memory slots before registering all cvimodels.
+ * 0 (default) means all models use one shared memory region, and
+ * inferences of different models must not run concurrently. Otherwise
+ * each inference holds one of at most num slots, and waits if all are
+ * busy. Exported tensors in shared memory then get host buffers which
+ * are copied in and out by forward, and frames can't be preloaded into
+ * them, SetTensorWithAlignedFrames and the like return CVI_RC_UNSUPPORT.
+ */
+void CVI_NN_Global_SetSharedMemorySlotNum(int num);
+
+/*
+ * set number of threads used to load sections of cvimodel concurrently,
+ * 0 means decided by env TPU_LOAD_THREADS or cpu count (at most 4).
+ * Memory allocation callbacks must be thread-safe if num is not 1.
+ */
+void CVI_NN_Global_SetLoadThreadNum(int num);
+
+/*
+ * set number of worker threads serving ForwardAsync of each model
+ * registered later, 0 means decided by env TPU_ASYNC_WORKERS (default 1).
+ * Async tasks of same model handle are always run one by one and complete
+ * in submission order, more workers help only if cloned handles of the
+ * model run concurrently.
+ */
+void CVI_NN_Global_SetAsyncWorkerNum(int num);
+
 #ifdef __cplusplus
 }
 #endif
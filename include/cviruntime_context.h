@@ -64,6 +64,14 @@ CVI_RC CVI_RT_RunCmdbuf(
 CVI_RC CVI_RT_RunCmdbufEx(
     CVI_RT_HANDLE rt_handle, CVI_RT_MEM cmdbuf_mem,
     CVI_RT_ARRAYBASE *p_array_base);
+/*
+ * copy header of a loaded dmabuf, which runs the same commands but has
+ * its own base address fields, so RunCmdbufEx on it doesn't modify the
+ * shared dmabuf. Returns CVI_RC_UNSUPPORT if not needed by backend.
+ */
+CVI_RC CVI_RT_DupDmabufHeader(
+    CVI_RT_HANDLE rt_handle, CVI_RT_MEM dmabuf_mem,
+    CVI_RT_MEM *header_mem);
 
 CVI_RC CVI_RT_LoadCmdbufTee(
     CVI_RT_HANDLE rt_handle, uint8_t *cmdbuf,
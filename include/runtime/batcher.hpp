@@ -0,0 +1,73 @@
+#ifndef RUNTIME_BATCHER_H
+#define RUNTIME_BATCHER_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <runtime/model.hpp>
+#include "cviruntime.h"
+
+namespace cvi {
+namespace runtime {
+
+// Dynamic batching front-end over the multi-batch programs of a model.
+// Single sample requests from many threads are queued, and a worker
+// coalesces them into the largest batch program that can be filled
+// within max_delay_us since the oldest request arrived, then scatters
+// outputs back to the callers.
+class Batcher {
+public:
+  Batcher(CviModel *model, int max_delay_us);
+  ~Batcher();
+
+  CVI_RC init();
+  // blocking until the sample is inferred, tensors are of one sample.
+  CVI_RC forward(CVI_TENSOR *inputs, int input_num,
+                 CVI_TENSOR *outputs, int output_num);
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  struct BatchProgram {
+    Program *program;
+    int batch;
+    CVI_TENSOR *inputs;
+    CVI_TENSOR *outputs;
+    int32_t input_num;
+    int32_t output_num;
+  };
+
+  struct Request {
+    CVI_TENSOR *inputs;
+    CVI_TENSOR *outputs;
+    clock::time_point arrival;
+    CVI_RC ret;
+    bool done;
+    std::condition_variable cond;
+  };
+
+  CVI_RC addProgram(int program_id);
+  BatchProgram *pickProgram(size_t pending);
+  CVI_RC runBatch(BatchProgram &bp, std::vector<Request *> &reqs);
+  void workFunc();
+
+  CviModel *_model;
+  std::chrono::microseconds _max_delay;
+  // sorted by batch, ascending
+  std::vector<BatchProgram> _programs;
+  std::vector<size_t> _input_sizes;  // bytes per sample
+  std::vector<size_t> _output_sizes; // bytes per sample
+  std::deque<Request *> _queue;
+  bool _done = false;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::thread _worker;
+};
+
+} // namespace runtime
+} // namespace cvi
+
+#endif
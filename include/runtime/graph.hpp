@@ -0,0 +1,39 @@
+#ifndef RUNTIME_GRAPH_H
+#define RUNTIME_GRAPH_H
+
+#include <vector>
+#include <functional>
+#include "cviruntime.h"
+
+namespace cvi {
+namespace runtime {
+
+// DAG of models, nodes run in dependency order. Each edge may carry
+// a transfer which runs after its source node, for tensors which
+// can't be shared in device memory. Nodes of same depth can run
+// concurrently.
+class Graph {
+public:
+  typedef std::function<CVI_RC()> task_t;
+
+  int addNode(const task_t &run);
+  CVI_RC addEdge(int from, int to, const task_t &transfer = nullptr);
+  CVI_RC run(bool parallel);
+
+private:
+  struct Node {
+    task_t run;
+    std::vector<task_t> transfers;
+    std::vector<int> succs;
+  };
+  CVI_RC runNode(int idx);
+  // nodes grouped by depth, empty if graph has cycle
+  std::vector<std::vector<int>> levels();
+
+  std::vector<Node> _nodes;
+};
+
+} // namespace runtime
+} // namespace cvi
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RUNTIME_HASH_H
+#define RUNTIME_HASH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+namespace cvi {
+namespace runtime {
+
+// 64bit FNV-1a, consumes 8 bytes per step.
+inline uint64_t contentHash(const void *data, size_t size) {
+  const uint8_t *buf = (const uint8_t *)data;
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, buf + i, 8);
+    hash = (hash ^ word) * prime;
+  }
+  for (; i < size; ++i) {
+    hash = (hash ^ buf[i]) * prime;
+  }
+  return hash;
+}
+
+} // namespace runtime
+} // namespace cvi
+
+#endif
@@ -12,11 +12,45 @@ CVI_RC runtimeExecuteKernelFunction(
     CVI_RT_HANDLE ctx, CVI_RT_MEM codeBuf,
     uint64_t gaddrSrc, uint64_t gaddrDst);
 
+// base reg 0 is destination, 1~7 are left for sources of frames.
+#define TDMA_GATHER_MAX_FRAMES 7
+
+CVI_RC runtimeExecuteGatherFunction(
+    CVI_RT_HANDLE ctx, CVI_RT_MEM codeBuf,
+    const uint64_t *gaddrSrcs, int frames, uint64_t gaddrDst);
+
 CVI_RT_MEM runtimeJitTdmaStrideCopy(
     CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
     cvk_tg_shape_t *shapeDst, cvk_tg_stride_t *strideDst,
     cvk_tg_shape_t *shapeSrc, cvk_tg_stride_t *strideSrc);
 
+// copy frames from separated buffers into one in a single submission.
+CVI_RT_MEM runtimeJitTdmaGatherCopy(
+    CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
+    int frames, uint64_t frameOffset,
+    cvk_tg_shape_t *shapeDst, cvk_tg_stride_t *strideDst,
+    cvk_tg_shape_t *shapeSrc, cvk_tg_stride_t *strideSrc);
+
+// Cmdbufs of tdma copy are shared process-wide by their parameters,
+// JIT is only done by the first caller. Each caller gets a handle of
+// its own to submit, and must return it by runtimeReleaseTdmaStrideCopy.
+CVI_RT_MEM runtimeAcquireTdmaStrideCopy(
+    CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
+    cvk_tg_shape_t *shapeDst, cvk_tg_stride_t *strideDst,
+    cvk_tg_shape_t *shapeSrc, cvk_tg_stride_t *strideSrc);
+
+CVI_RT_MEM runtimeAcquireTdmaGatherCopy(
+    CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
+    int frames, uint64_t frameOffset,
+    cvk_tg_shape_t *shapeDst, cvk_tg_stride_t *strideDst,
+    cvk_tg_shape_t *shapeSrc, cvk_tg_stride_t *strideSrc);
+
+// release handles of both stride copy and gather copy,
+// discard the cached cmdbuf, e.g. it failed to run,
+// so that next acquire JITs it again.
+void runtimeReleaseTdmaStrideCopy(
+    CVI_RT_HANDLE ctx, CVI_RT_MEM codeBuf, bool discard = false);
+
 CVI_RT_MEM runtimeJitMatrixMul(
     CVI_RT_HANDLE ctx, void* cvk_ctx, CVI_FMT fmt,
     uint32_t m, uint32_t k, uint32_t n);
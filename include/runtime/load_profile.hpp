@@ -0,0 +1,78 @@
+#ifndef RUNTIME_LOAD_PROFILE_H
+#define RUNTIME_LOAD_PROFILE_H
+
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "cviruntime.h"
+
+namespace cvi {
+namespace runtime {
+
+class LoadTimer {
+public:
+  LoadTimer() : _start(std::chrono::steady_clock::now()) {}
+  uint64_t elapsed_us() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point _start;
+};
+
+// Time and bytes spent on each phase of loading a model, sections
+// may be loaded by several threads, so records are protected by lock.
+class LoadProfile {
+public:
+  LoadProfile() {
+    memset(&_stats, 0, sizeof(_stats));
+  }
+
+  void addTotal(uint64_t time_us) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.total_us += time_us;
+  }
+
+  void addPhase(CVI_LOAD_PHASE_E phase, uint64_t time_us, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.phases[phase].time_us += time_us;
+    _stats.phases[phase].bytes += bytes;
+  }
+
+  void addSection(const std::string &name, int32_t type, uint64_t size,
+                  uint64_t loaded_size, uint64_t time_us) {
+    CVI_LOAD_SECTION_STAT stat;
+    memset(&stat, 0, sizeof(stat));
+    strncpy(stat.name, name.c_str(), sizeof(stat.name) - 1);
+    stat.type = type;
+    stat.size = size;
+    stat.loaded_size = loaded_size;
+    stat.time_us = time_us;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sections.push_back(stat);
+  }
+
+  void get(CVI_LOAD_STATS *stats, CVI_LOAD_SECTION_STAT *sections,
+           int32_t max_section_num) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    *stats = _stats;
+    stats->section_num = (int32_t)_sections.size();
+    for (int32_t i = 0; sections && i < max_section_num &&
+                        i < stats->section_num; ++i) {
+      sections[i] = _sections[i];
+    }
+  }
+
+private:
+  std::mutex _mutex;
+  CVI_LOAD_STATS _stats;
+  std::vector<CVI_LOAD_SECTION_STAT> _sections;
+};
+
+} // namespace runtime
+} // namespace cvi
+
+#endif
@@ -4,6 +4,7 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <cvibuilder/cvimodel_generated.h>
 #include <runtime/stream.hpp>
@@ -11,6 +12,7 @@
 #include <runtime/neuron.hpp>
 #include <runtime/cpu_function.hpp>
 #include <runtime/taskpool.hpp>
+#include <runtime/load_profile.hpp>
 
 namespace cvi {
 namespace runtime {
@@ -30,14 +32,28 @@ public:
   CviModel(CVI_RT_HANDLE ctx, int count);
 
   CVI_RC acquire(const int8_t *buf, size_t size);
-  CVI_RC acquire(const std::string &modelFile);
+  CVI_RC acquire(const std::string &modelFile, bool use_mmap = false,
+                 bool lazy_load = false);
   CVI_RC acquire(const int fd, const size_t ud_offset);
   void refer() { ref++; }
+  bool tryRefer();
   void release();
 
   CVI_RC loadProgram(Program **program,
       int program_id, bool export_all_tensors,
-      bool skip_preprocess);
+      bool skip_preprocess, CVI_RT_MEM private_mem = nullptr);
+  void unloadProgram(Program *program);
+
+  // load all programs, which share one private gmem sized to the
+  // largest of them, so only one of them can run at a time.
+  CVI_RC loadAllPrograms(std::vector<Program *> &programs,
+      bool export_all_tensors, bool skip_preprocess,
+      CVI_RT_MEM *private_mem);
+  void unloadAllPrograms(std::vector<Program *> &programs,
+      CVI_RT_MEM private_mem);
+
+  LoadProfile &loadProfile() { return _load_profile; }
+  CVI_RT_HANDLE context() { return _ctx; }
 
   static std::string getChipType(const std::string &modelFile,
       const int8_t *buf = nullptr, size_t size = 0);
@@ -49,14 +65,31 @@ public:
   // global info
   static std::string targetChipType;
 
+  // number of threads to load sections, 0 means decided by
+  // env TPU_LOAD_THREADS or cpu count.
+  static int loadThreadNum;
+  static void setLoadThreadNum(int num);
+
 private:
   ~CviModel();
 
+  CVI_RC acquire(BaseStream *stream);
   CVI_RC parse(BaseStream *stream);
   CVI_RC loadWeight(BaseStream *stream, size_t offset, size_t size);
-  CVI_RC loadDmabuf(BaseStream *stream, size_t offset, size_t size, const cvi::model::Section *section);
-  CVI_RC loadCmdbuf(BaseStream *stream, size_t offset, size_t size, const cvi::model::Section *section);
+  CVI_RC loadDmabuf(BaseStream *stream, size_t offset, size_t size,
+                    const cvi::model::Section *section, CVI_RT_MEM *mem);
+  CVI_RC loadCmdbuf(BaseStream *stream, size_t offset, size_t size,
+                    const cvi::model::Section *section, CVI_RT_MEM *mem);
+  CVI_RC readStream(BaseStream *stream, uint8_t *buf, size_t offset, size_t size);
+  CVI_RC decompressSection(BaseStream *stream, size_t offset, size_t size,
+                           uint8_t *dst, size_t dst_size);
   CVI_RC extractSections(BaseStream *stream, size_t bin_offset);
+  CVI_RC loadSections(BaseStream *stream, size_t bin_offset,
+                      const std::vector<const cvi::model::Section*> &sections);
+  CVI_RC acquireProgramSections(const cvi::model::Program *fb_program);
+  void releaseProgramSections(const cvi::model::Program *fb_program);
+  void freeSectionMem(CVI_RT_MEM mem);
+  void recordSection(const cvi::model::Section *section, uint64_t time_us);
   CVI_RC parseModelHeader(BaseStream *stream, size_t &payload_sz,
                           size_t &header_sz);
   bool checkIfMatchTargetChipType(std::string &target);
@@ -69,6 +102,15 @@ private:
   TaskPool *_pool = nullptr;
   cvi::model::Model *_fb_model;
   uint8_t *_model_body = nullptr;
+  BaseStream *_stream = nullptr; // kept alive if _fb_model points into it
+  // cmdbuf/dmabuf sections loaded on demand by loadProgram
+  bool _lazy_load = false;
+  size_t _bin_offset = 0;
+  std::mutex _section_mutex;
+  std::map<std::string, const cvi::model::Section *> _lazy_sections;
+  std::map<std::string, int> _section_refs;
+  std::map<Program *, int> _program_ids;
+  LoadProfile _load_profile;
   CVI_RT_MEM _weight_mem = nullptr;
   CustomFunctionSection _custom_section;
   std::vector<CpuRuntimeFunction *> _cpu_functions;
@@ -79,6 +121,7 @@ private:
   int _count;
   std::string _model_name;
   size_t _max_shared_mem_size;
+  size_t _max_private_mem_size;
 };
 
 } // namespace runtime
@@ -0,0 +1,29 @@
+#ifndef RUNTIME_MODEL_CACHE_H
+#define RUNTIME_MODEL_CACHE_H
+
+#include <string>
+#include <runtime/model.hpp>
+
+namespace cvi {
+namespace runtime {
+
+// Keys identify the content of a cvimodel, an empty key means the
+// model can't be cached.
+std::string modelCacheKeyOfFile(const char *file);
+std::string modelCacheKeyOfFd(int fd, size_t ud_offset);
+std::string modelCacheKeyOfBuffer(const int8_t *buf, size_t size);
+
+bool modelCacheEnabled();
+// return a referenced model registered with the same key, or nullptr.
+// In the latter case the key is claimed by the caller, which must publish
+// the model it loads by insertCachedModel, or give up by abandonCachedModel.
+// Other lookups of the key wait for it meanwhile.
+CviModel *lookupCachedModel(const std::string &key);
+void insertCachedModel(const std::string &key, CviModel *model);
+void abandonCachedModel(const std::string &key);
+void removeCachedModel(CviModel *model);
+
+} // namespace runtime
+} // namespace cvi
+
+#endif
@@ -14,6 +14,12 @@
 namespace cvi {
 namespace runtime {
 
+// bytes of cache maintenance issued by neurons of a program
+struct CacheStats {
+  uint64_t flushed = 0;
+  uint64_t invalidated = 0;
+};
+
 class Neuron {
 public:
   enum NeuronState {
@@ -26,6 +32,16 @@ public:
     ACTIVATION  = 1,
   };
 
+  // cache maintenance or copy to move tensor between cpu and tpu,
+  // decided by Program at load time.
+  enum Transfer {
+    FLUSH       = 0, // cpu -> tpu, same memory
+    COPY_S2D    = 1, // cpu -> tpu, from _cpu_mem
+    INVALIDATE  = 2, // tpu -> cpu, same memory
+    COPY_D2S    = 3, // tpu -> cpu, to _cpu_mem
+    FLUSH_DIRTY = 4, // flush if written by cpu, see flushDirty()
+  };
+
   Neuron(CVI_RT_HANDLE ctx, const void *model_tensor,
          CVI_RT_MEM weight_mem, const char *model_name);
   Neuron(CVI_RT_HANDLE ctx, CVI_RT_HANDLE cvk,
@@ -69,6 +85,19 @@ public:
     return _paddr;
   }
 
+  inline int32_t baseAddrIndex() {
+    return _baseAddrIndex;
+  }
+
+  inline void setCacheStats(CacheStats *stats) {
+    _cache_stats = stats;
+  }
+
+  // written by cpu, cache lines need to be flushed before tpu runs.
+  inline void markDirty() {
+    _dirty = (_gmem != nullptr);
+  }
+
   inline float qscale() {
     return _qscale;
   }
@@ -81,25 +110,57 @@ public:
     return _zero_point;
   }
 
-  CVI_RC preloadChannelAndCompact(int32_t channel_idx, uint64_t src_paddr);
-  CVI_RC preloadFrameAndCompact(int32_t frame_idx, uint64_t src_paddr);
-  CVI_RC preload(int32_t frame_idx, uint64_t src_paddr);
+  // gather channels of a frame, or frames of vpss buffers into neuron.
+  CVI_RC preloadChannels(const uint64_t *src_paddrs, int32_t channel_num);
+  CVI_RC preloadFrames(const uint64_t *src_paddrs, int32_t frame_num);
+  // JIT cmdbufs of preload paths ahead of first frame.
+  void warmup();
 
   void load(CVI_TENSOR &tensor);
   void store(CVI_TENSOR &tensor);
   void toCpu();
-  void toTpu();
+  void flushDirty();
+  void transfer(Transfer op);
+  inline bool hasDeviceMem() {
+    return _gmem || _vaddr;
+  }
+  inline Transfer tpuTransfer() {
+    return _cpu_mem ? COPY_S2D : FLUSH;
+  }
+  inline Transfer cpuTransfer() {
+    return _cpu_mem ? COPY_D2S : INVALIDATE;
+  }
   CVI_RC reserveIonMem(int64_t offset);
   CVI_RC reserveSysMem();
+  // use memory of program's cpu arena instead of allocating.
+  inline void setSysMem(uint8_t *mem) {
+    _cpu_mem = mem;
+    _cpu_mem_owned = false;
+  }
   void updateBaseAddr(uint64_t paddr);
+  // move a neuron of shared memory onto another slot of shared memory pool.
+  void rebaseSharedMem(CVI_RT_MEM mem);
+  CVI_RC bindDeviceMem(uint64_t paddr, uint8_t *vaddr);
+  // exchange io mem with other neuron, for state tensors which are
+  // written as output and read as input of next inference.
+  void swapDeviceMem(Neuron &other);
+  // in io mem allocated for itself, or bound to a device buffer.
+  inline bool ownsIoMem() {
+    return _baseAddrIndex >= 3 && _gmem == _base_mem && _vaddr;
+  }
   bool isPacked();
 
 private:
   void updateBaseAddr(CVI_RT_MEM mem);
+  void flush(size_t len);
+  void invalidate(size_t len);
   inline void setZeroPoint(int zp) { _zero_point = zp; }
   void setPixelFormatAndSize(const std::string &pixel_format, int32_t dsize);
   void setPixelAlign(CVI_NN_PIXEL_FORMAT_E format);
   uint32_t yuv_size(int n, int c, int h, int w, CVI_NN_PIXEL_FORMAT_E format);
+  void channelShape(uint32_t &c, uint32_t &h, uint32_t &w);
+  CVI_RT_MEM jitGather(bool channel, int num, uint64_t &offset);
+  CVI_RC gather(bool channel, const uint64_t *src_paddrs, int32_t num);
 
 public:
   std::string name;
@@ -116,11 +177,16 @@ private:
   CVI_RT_HANDLE _ctx;
   CVI_RT_KHANDLE _cvk;
   CVI_RT_MEM _streamCopyCmdbuf = nullptr;
-  CVI_RT_MEM _channelPreloadCmdbuf = nullptr;
-  CVI_RT_MEM _framePreloadCmdbuf = nullptr;
+  // gather cmdbufs of preload, by number of channels or frames.
+  std::map<int, CVI_RT_MEM> _channelGatherCmdbufs;
+  std::map<int, CVI_RT_MEM> _frameGatherCmdbufs;
   CVI_RT_MEM _base_mem = nullptr;
   CVI_RT_MEM _gmem = nullptr;
+  // prealloc mems of neuron on each slot of shared memory pool
+  std::map<CVI_RT_MEM, CVI_RT_MEM> _shared_gmems;
+  uint64_t _shift = 0;
   uint8_t* _cpu_mem = nullptr;
+  bool _cpu_mem_owned = true;
   uint8_t* _vaddr = nullptr;
   uint64_t _paddr = 0;
   NeuronState _state;
@@ -129,6 +195,8 @@ private:
   uint32_t _size;
   uint32_t _tensor_size = 0;
   bool _overwrote = false;
+  bool _dirty = false;
+  CacheStats *_cache_stats = nullptr;
   float _qscale = 1.0f;
   int _zero_point = 0;
   uint64_t *_baseAddrArray;
@@ -0,0 +1,86 @@
+#ifndef RUNTIME_PIPELINE_H
+#define RUNTIME_PIPELINE_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <runtime/program.hpp>
+#include "cviruntime.h"
+
+namespace cvi {
+namespace runtime {
+
+// Two stages pipeline over double-buffered Program instances of
+// the same program. Head stage (inputs loading and tpu routines) runs
+// in caller's thread, tail stage (trailing cpu routines and outputs
+// storing) runs in a worker thread. So tpu routines of request N+1
+// overlap with cpu routines of request N, and results are delivered
+// in submission order.
+class Pipeline {
+public:
+  static const int SLOT_NUM = 2;
+
+  // slots are loaded from same program, and owned by caller.
+  Pipeline(Program *slots[SLOT_NUM]);
+  ~Pipeline();
+
+  CVI_TENSOR *exportInputs(int32_t &size);
+  CVI_TENSOR *exportOutputs(int32_t &size);
+
+  // if callback is given, it's invoked in worker thread and the
+  // returned task needn't be waited. event_fd, if not -1, is signalled
+  // once the task is done, after the callback if any.
+  void *submit(CVI_TENSOR *inputs, int input_num,
+               CVI_TENSOR *outputs, int output_num,
+               CVI_NN_FORWARD_CALLBACK callback = nullptr,
+               void *model = nullptr, void *user_data = nullptr,
+               int event_fd = -1);
+  CVI_RC wait(void *task);
+  // return CVI_RC_AGAIN if task is not done yet
+  CVI_RC poll(void *task);
+
+private:
+  struct Task {
+    int slot;
+    CVI_TENSOR *outputs;
+    int output_num;
+    // outputs are stored here by tail stage, and copied to
+    // caller's outputs when task is waited or before callback.
+    std::vector<CVI_TENSOR> staged;
+    uint8_t *staging;
+    size_t staging_size;
+    bool head_ok;
+    bool done;
+    CVI_RC ret;
+    CVI_NN_FORWARD_CALLBACK callback;
+    void *model;
+    void *user_data;
+    int event_fd;
+  };
+
+  void workFunc();
+  uint8_t *allocStaging(size_t size);
+  bool stageOutputs(Task *task);
+  CVI_RC finishTask(Task *task);
+
+  Program *_slots[SLOT_NUM];
+  bool _slot_busy[SLOT_NUM];
+  int _next_slot = 0;
+  bool _done = false;
+  std::deque<Task *> _queue;
+  std::vector<uint8_t *> _staging;
+  // free staging buffers of finished tasks, protected by _mutex
+  std::vector<std::pair<uint8_t *, size_t>> _free_task_staging;
+  std::mutex _submit_mutex;
+  std::mutex _mutex;
+  std::condition_variable _cond_queue;
+  std::condition_variable _cond_feedback;
+  std::thread _worker;
+};
+
+} // namespace runtime
+} // namespace cvi
+
+#endif
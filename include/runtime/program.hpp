@@ -3,10 +3,12 @@
 
 #include <map>
 #include <list>
+#include <deque>
 #include <vector>
 #include <unordered_map>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include <runtime/neuron.hpp>
 #include <runtime/stream.hpp>
 #include <runtime/section.hpp>
@@ -37,19 +39,53 @@ public:
 
   void setOptions(bool export_all_tensors,
                   bool skip_preprocess);
+  // use private gmem owned by caller, which may be shared by programs
+  // that never run at the same time. Must be called before load().
+  void setPrivateMem(CVI_RT_MEM mem) {
+    private_mem = mem;
+    _private_mem_owned = false;
+  }
   CVI_RC load(const cvi::model::Program *fb_program);
 
   bool forward(CVI_TENSOR *inputs, int input_num,
                CVI_TENSOR *outputs, int output_num);
 
   void *forwardAsync(CVI_TENSOR *inputs, int input_num,
-                     CVI_TENSOR *outputs, int output_num);
+                     CVI_TENSOR *outputs, int output_num,
+                     CVI_NN_FORWARD_CALLBACK callback = nullptr,
+                     void *model = nullptr, void *user_data = nullptr,
+                     int event_fd = -1);
 
   CVI_RC forwardWait(void *task);
+  CVI_RC forwardPoll(void *task);
+
+  // Split of forward for pipelined execution, head loads inputs and
+  // runs routines up to the last tpu routine, tail runs the remaining
+  // cpu routines and stores outputs.
+  bool forwardHead(CVI_TENSOR *inputs, int input_num);
+  bool forwardTail(CVI_TENSOR *outputs, int output_num);
+  bool pipelineable();
 
   const tensor_list_t &input_tensors() { return in_tensors; }
+
+  // neuron lives in a slot of shared memory pool, which is only
+  // held by the program during an inference.
+  bool inSharedMemPool(const std::shared_ptr<Neuron> &neuron);
   const tensor_list_t &output_tensors() { return out_tensors; }
 
+  // let tpu write the output into user's device buffer directly.
+  CVI_RC bindOutput(const std::string &name, uint64_t paddr, uint8_t *vaddr);
+
+  // read the input from device buffer of another model's output directly.
+  CVI_RC bindInput(const std::string &name, uint64_t paddr, uint8_t *vaddr);
+
+  // output becomes the input of next forward by swapping their io mem,
+  // the state is kept in device memory until resetStates().
+  CVI_RC bindState(const std::string &output_name, const std::string &input_name);
+  void resetStates();
+  // neuron is an output of cpu routine, so it may be left in cache.
+  bool writtenByCpu(const std::shared_ptr<Neuron> &neuron);
+
   CVI_TENSOR *exportInputs(int32_t &size);
   CVI_TENSOR *exportOutputs(int32_t &size);
 
@@ -67,11 +103,39 @@ public:
   uint64_t baseAddrArray[8];
   CVI_RT_MEM baseMemArray[8];
 
+  // cache maintenance of last inference
+  CacheStats cache_stats;
+
+  // bytes of cpu arena, and the sum of cpu tensors sharing it
+  size_t cpu_arena_size = 0;
+  size_t cpu_tensors_size = 0;
+
+  // async tasks of this program run in submission order, only one
+  // worker at a time drains the queue, see TaskPool::addTask().
+  std::mutex async_mutex;
+  std::deque<Task *> async_queue;
+  bool async_running = false;
+
+  // load time of program, in us
+  uint64_t load_time_us = 0;
+  uint64_t neuron_map_time_us = 0;
+  uint64_t cpu_setup_time_us = 0;
+
 private:
   CVI_RC createNeuronSpace(const cvi::model::Program *fb_program);
   CVI_RC createNeuronMap(const cvi::model::Program *fb_program);
   CVI_RC createRoutines(const cvi::model::Program *fb_program);
+  void planTransfers();
+  CVI_RC createCpuArena();
   bool run();
+  void loadInputs(CVI_TENSOR *inputs, int input_num);
+  void storeOutputs(CVI_TENSOR *outputs, int output_num);
+  void runRoutines(size_t begin, size_t end);
+  void updateStates();
+  bool ownsIoIndex(const std::shared_ptr<Neuron> &neuron);
+  CVI_RT_MEM acquireSharedMem();
+  void releaseSharedMem(CVI_RT_MEM mem);
+  void stageSharedTensor(const std::shared_ptr<Neuron> &neuron, CVI_TENSOR *tensor);
 
   CVI_RT_HANDLE _ctx;
   CVI_RT_KHANDLE _cvk;
@@ -79,8 +143,23 @@ private:
   bool _skip_preprocess;
   TaskPool *_pool = nullptr;
   CVI_RT_MEM private_mem = nullptr;
+  bool _private_mem_owned = true;
   CVI_RT_MEM shared_mem = nullptr;
+  struct StateBinding {
+    std::shared_ptr<Neuron> output;
+    std::shared_ptr<Neuron> input;
+    // input holds the state of last forward, not loaded from caller
+    bool primed;
+  };
+  std::vector<StateBinding> _states;
+  // neurons in shared memory, rebased when using a slot of pool
+  tensor_list_t _shared_neurons;
+  // host copies of exported tensors in shared memory, see stageSharedTensor()
+  std::vector<uint8_t *> _staging_bufs;
+  uint8_t *_cpu_arena = nullptr;
   std::list<std::shared_ptr<Routine>> _routines;
+  // number of routines in head stage, see forwardHead()
+  size_t _head_routine_num = 0;
   std::string _model_name;
   size_t _max_shared_mem_size;
 };
@@ -94,8 +173,15 @@ public:
   virtual CVI_RC run() = 0;
   virtual void reset() = 0;
   virtual CVI_RC prepare() { return CVI_RC_SUCCESS; }
+  // replay transfers of inputs planned by Program::planTransfers()
+  void transferInputs() {
+    for (auto &step : plan) {
+      step.first->transfer(step.second);
+    }
+  }
   tensor_list_t inputs;
   tensor_list_t outputs;
+  std::vector<std::pair<std::shared_ptr<Neuron>, Neuron::Transfer>> plan;
   bool tpu;
 
 protected:
@@ -108,6 +194,9 @@ public:
   TpuRoutine(CVI_RT_HANDLE ctx, Program *program)
     : Routine(ctx, program, true) {}
   ~TpuRoutine() {
+    if (header_mem) {
+      CVI_RT_MemFree(_ctx, header_mem);
+    }
   }
 
   bool initialize(const cvi::model::Routine *routine);
@@ -117,6 +206,9 @@ public:
 
 private:
   CVI_RT_MEM buf_mem = nullptr;
+  // private copy of dmabuf header, base addresses of this program are
+  // written into it on submission, see CVI_RT_DupDmabufHeader.
+  CVI_RT_MEM header_mem = nullptr;
   bool enable_pmu = false;
   bool encrypted = false;
 };
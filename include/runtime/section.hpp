@@ -30,6 +30,8 @@ public:
   ICpuFunctionCreate func_open;
 };
 
+struct CustomFunctionDso;
+
 class CustomFunctionSection {
 public:
   CustomFunctionSection() = default;
@@ -38,8 +40,8 @@ public:
             std::vector<CpuRuntimeFunction *> &cpu_functions);
 
 private:
-  int shm_fd = 0;
-  void *dso_handle = nullptr;
+  // dlopen'ed libraries, shared by all models with same section content
+  std::vector<CustomFunctionDso *> _dsos;
 };
 
 } // namespace runtime
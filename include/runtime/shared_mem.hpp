@@ -10,6 +10,14 @@ void setSharedMemSize(size_t size);
 CVI_RT_MEM allocateSharedMemory(CVI_RT_HANDLE ctx, size_t size);
 void deallocateSharedMemory(CVI_RT_HANDLE ctx, CVI_RT_MEM mem);
 
+// Pool of shared memory slots, programs hold a slot during inference,
+// so that at most num programs use shared memory at the same time.
+void setSharedMemSlotNum(int num);
+int sharedMemSlotNum();
+// block until a slot of at least size bytes is free.
+CVI_RT_MEM acquireSharedMemSlot(CVI_RT_HANDLE ctx, size_t size);
+void releaseSharedMemSlot(CVI_RT_MEM mem);
+
 } // namespace runtime
 } // namespace cvi
 
@@ -16,8 +16,19 @@ public:
     return _length;
   }
 
+  // read() is thread-safe, it returns less than size only if the
+  // stream fails or ends.
   virtual size_t read(uint8_t *buf, size_t offset, size_t size) = 0;
 
+  // hint that [offset, offset + size) will be read soon.
+  virtual void readahead(size_t, size_t) {}
+
+  // Return a pointer to [offset, offset + size) if the stream is backed by
+  // memory which stays valid for the stream's lifetime, nullptr otherwise.
+  virtual const uint8_t *data(size_t, size_t) {
+    return nullptr;
+  }
+
 protected:
   size_t _length = 0;
 };
@@ -27,8 +38,9 @@ public:
   FileStream(const std::string &file_name);
   ~FileStream();
   size_t read(uint8_t *buf, size_t offset, size_t size);
+  void readahead(size_t offset, size_t size);
 private:
-  std::ifstream *_fstream;
+  int _fd = -1;
 };
 
 class BufferStream : public BaseStream {
@@ -46,11 +58,24 @@ public:
   FdStream(const int fd, const size_t ud_offset);
   ~FdStream() {};
   size_t read(uint8_t *buf, size_t offset, size_t size);
+  void readahead(size_t offset, size_t size);
 private:
   int file_descriptor;
   size_t user_define_offset = 0; //The file header's offset that user defined.
 };
 
+class MmapStream : public BaseStream {
+public:
+  MmapStream(const std::string &file_name);
+  ~MmapStream();
+  size_t read(uint8_t *buf, size_t offset, size_t size);
+  const uint8_t *data(size_t offset, size_t size);
+  void readahead(size_t offset, size_t size);
+private:
+  void dropPages(size_t offset, size_t size);
+  uint8_t *_addr = nullptr;
+};
+
 } // namespace runtime
 } // namespace cvi
 
@@ -5,6 +5,7 @@
 #ifndef RUNTIME_TASKQUE_H
 #define RUNTIME_TASKQUE_H
 
+#include <atomic>
 #include <future>
 #include <thread>
 #include <deque>
@@ -21,17 +22,39 @@ namespace runtime {
 
 class TaskPool;
 
+// add 1 to counter of eventfd to wake up poller.
+void signalEventFd(int fd);
+
 class Task {
 public:
-  Task(TaskPool *pool, void *program, CVI_TENSOR *inputs, int input_num,
-       CVI_TENSOR *outputs, int output_num);
-
-  void *program;
-  int input_num;
-  int output_num;
-  CVI_TENSOR *inputs;
-  CVI_TENSOR *outputs;
+  Task() {}
+
+  void reset(void *program, CVI_TENSOR *inputs, int input_num,
+             CVI_TENSOR *outputs, int output_num,
+             CVI_NN_FORWARD_CALLBACK callback = nullptr,
+             void *model = nullptr, void *user_data = nullptr,
+             int event_fd = -1);
+  // called by worker after forwarding is done
+  void complete(CVI_RC ret);
+  CVI_RC wait();
+  // return CVI_RC_AGAIN if task is not done yet
+  CVI_RC poll();
+
+  void *program = nullptr;
+  int input_num = 0;
+  int output_num = 0;
+  CVI_TENSOR *inputs = nullptr;
+  CVI_TENSOR *outputs = nullptr;
   CVI_RC retCode = CVI_RC_UNINIT;
+  CVI_NN_FORWARD_CALLBACK callback = nullptr;
+  void *model = nullptr;
+  void *user_data = nullptr;
+  // eventfd signalled on completion, -1 if not used
+  int event_fd = -1;
+
+private:
+  std::mutex _mutex;
+  std::condition_variable _cond;
 };
 
 class RingQueue {
@@ -90,12 +113,22 @@ public:
   ~TaskPool();
 
   void startPool();
-  void addTask(Task *task) { _queue.put(task); }
-  void waitTask(Task *task);
+  // get a recycled task or a new one, it's recycled by
+  // waitTask() or after callback is invoked.
+  Task *acquireTask();
+  void addTask(Task *task);
+  CVI_RC waitTask(Task *task);
+  CVI_RC pollTask(Task *task);
   void workFunc();
 
+  // number of workers of pools created later, 0 means decided
+  // by env TPU_ASYNC_WORKERS, default is 1.
+  static int workerNum;
+  static int getWorkerNum();
+
 private:
   void addTerminateTask() { _queue.put(nullptr); }
+  void releaseTask(Task *task);
   static void run(TaskPool *pool) { pool->workFunc(); }
 
   int _pool_size;
@@ -104,7 +137,9 @@ private:
   std::atomic<bool> _done;
   std::mutex _mutex;
   std::vector<std::thread> _threads;
-  std::condition_variable _cond_feedback;
+  std::mutex _task_mutex;
+  std::vector<Task *> _free_tasks;
+  std::vector<Task *> _all_tasks;
 };
 
 }
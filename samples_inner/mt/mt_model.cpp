@@ -30,16 +30,11 @@ static void store_result(std::string name, CVI_TENSOR *tensor) {
 }
 */
 
-Encoder::Encoder(const char *model_file) {
-  int ret = CVI_NN_RegisterModel(model_file, &model);
+Encoder::Encoder(CVI_MODEL_HANDLE model) : model(model) {
+  int ret = CVI_NN_GetProgramInputOutputTensors(model, 0, &input_tensors, &input_num,
+                                                &output_tensors, &output_num);
   if (ret != CVI_RC_SUCCESS) {
-    printf("CVI_NN_RegisterModel failed, err %d\n", ret);
-    exit(1);
-  }
-  ret = CVI_NN_GetInputOutputTensors(model, &input_tensors, &input_num,
-                                     &output_tensors, &output_num);
-  if (ret != CVI_RC_SUCCESS) {
-    printf("CVI_NN_GetInputOutputTensors failed, err %d\n", ret);
+    printf("CVI_NN_GetProgramInputOutputTensors failed, err %d\n", ret);
     exit(1);
   }
   assert(input_num == 2);
@@ -84,42 +79,20 @@ bf16_t* Encoder::run(int16_t *seq, int32_t size) {
   printf("\n");
   */
   // run inference
-  CVI_NN_Forward(model, input_tensors, input_num,
-                 output_tensors, output_num);
+  CVI_NN_ForwardProgram(model, 0, input_tensors, input_num,
+                        output_tensors, output_num);
   //store_result("xx_enc_output.npz", enc_output);
 
   return (bf16_t *)CVI_NN_TensorPtr(enc_output);
 }
 
-Decoder::Decoder(CVI_MODEL_HANDLE main_model, int32_t max_step)
-  : max_step(max_step) {
-  int ret = CVI_NN_CloneModel(main_model, &model);
-  if (ret != CVI_RC_SUCCESS) {
-    printf("CVI_NN_RegisterModel failed, err %d\n", ret);
-    exit(1);
-  }
-  CVI_NN_SetConfig(model, OPTION_BATCH_SIZE, 1);
-  switch(max_step) {
-    case 0:
-      CVI_NN_SetConfig(model, OPTION_PROGRAM_INDEX, 1);
-      break;
-    case 10:
-      CVI_NN_SetConfig(model, OPTION_PROGRAM_INDEX, 2);
-      break;
-    case 20:
-      CVI_NN_SetConfig(model, OPTION_PROGRAM_INDEX, 3);
-      break;
-    case 30:
-      CVI_NN_SetConfig(model, OPTION_PROGRAM_INDEX, 4);
-      break;
-    case 39:
-      CVI_NN_SetConfig(model, OPTION_PROGRAM_INDEX, 5);
-      break;
-  }
-  ret = CVI_NN_GetInputOutputTensors(model, &input_tensors, &input_num,
-                                     &output_tensors, &output_num);
+Decoder::Decoder(CVI_MODEL_HANDLE model, int32_t program_id, int32_t max_step)
+  : max_step(max_step), model(model), program_id(program_id) {
+  int ret = CVI_NN_GetProgramInputOutputTensors(model, program_id,
+                                                &input_tensors, &input_num,
+                                                &output_tensors, &output_num);
   if (ret != CVI_RC_SUCCESS) {
-    printf("CVI_NN_GetInputOutputTensors failed, err %d\n", ret);
+    printf("CVI_NN_GetProgramInputOutputTensors failed, err %d\n", ret);
     exit(1);
   }
   assert(input_num == 4);
@@ -179,13 +152,34 @@ int16_t Decoder::run(int step, int16_t *seq, bf16_t *enc, bf16_t *mask) {
   CVI_NN_SetTensorPtr(enc_output, enc);
   CVI_NN_SetTensorPtr(src_mask, mask);
   // run inference
-  CVI_NN_Forward(model, input_tensors, input_num,
-                 output_tensors, output_num);
+  CVI_NN_ForwardProgram(model, program_id, input_tensors, input_num,
+                        output_tensors, output_num);
   // std::string name = "xx_decode_" + std::to_string(step) + "_out.npz";
   // store_result(name, dec_output);
   return argmax(step);
 }
 
+MTrans::MTrans(const char *cvimodel) {
+  int ret = CVI_NN_RegisterModel(cvimodel, &model);
+  if (ret != CVI_RC_SUCCESS) {
+    printf("CVI_NN_RegisterModel failed, err %d\n", ret);
+    exit(1);
+  }
+  CVI_NN_SetConfig(model, OPTION_MULTI_PROGRAM, true);
+  ret = CVI_NN_GetInputOutputTensors(model, NULL, NULL, NULL, NULL);
+  if (ret != CVI_RC_SUCCESS) {
+    printf("CVI_NN_GetInputOutputTensors failed, err %d\n", ret);
+    exit(1);
+  }
+  // program 0 is encoder, 1~5 are decoders of different max steps.
+  encoder = new Encoder(model);
+  decoder_0 = new Decoder(model, 1, 0);
+  decoder_10 = new Decoder(model, 2, 10);
+  decoder_20 = new Decoder(model, 3, 20);
+  decoder_30 = new Decoder(model, 4, 30);
+  decoder_39 = new Decoder(model, 5, 39);
+}
+
 void MTrans::run(int16_t *seq, int32_t seq_sz, int16_t *gen_seq, int32_t gen_seq_sz) {
   // clean gen_seq array.
   memset(gen_seq, 0, gen_seq_sz * sizeof(int16_t));
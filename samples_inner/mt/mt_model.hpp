@@ -21,18 +21,12 @@ typedef uint16_t bf16_t;
 
 class Encoder {
 public:
-  Encoder(const char *model_file);
-  ~Encoder() {
-    if (model) {
-      CVI_NN_CleanupModel(model);
-    }
-  }
+  Encoder(CVI_MODEL_HANDLE model);
 
   bf16_t* run(int16_t *seq, int32_t size);
   bf16_t* get_mask();
 
 public:
-  CVI_MODEL_HANDLE model = nullptr;
   CVI_TENSOR *src_seq;
   CVI_TENSOR *src_mask;
   CVI_TENSOR *enc_output;
@@ -40,6 +34,7 @@ public:
 private:
   void gen_src_mask(int16_t *src_seq, int32_t size);
 
+  CVI_MODEL_HANDLE model = nullptr;
   CVI_TENSOR *input_tensors;
   CVI_TENSOR *output_tensors;
   int32_t input_num;
@@ -48,12 +43,7 @@ private:
 
 class Decoder {
 public:
-  Decoder(CVI_MODEL_HANDLE model, int32_t max_step);
-  ~Decoder() {
-    if (model) {
-      CVI_NN_CleanupModel(model);
-    }
-  }
+  Decoder(CVI_MODEL_HANDLE model, int32_t program_id, int32_t max_step);
 
   int16_t run(int step, int16_t *seq,
               bf16_t *enc, bf16_t *mask);
@@ -72,6 +62,7 @@ private:
   void gen_trg_mask();
   int16_t argmax(int32_t step);
   CVI_MODEL_HANDLE model = nullptr;
+  int32_t program_id;
   CVI_TENSOR *input_tensors;
   CVI_TENSOR *output_tensors;
   int32_t input_num;
@@ -80,14 +71,7 @@ private:
 
 class MTrans {
 public:
-  MTrans(const char *cvimodel) {
-    encoder = new Encoder(cvimodel);
-    decoder_0 = new Decoder(encoder->model, 0);
-    decoder_10 = new Decoder(encoder->model, 10);
-    decoder_20 = new Decoder(encoder->model, 20);
-    decoder_30 = new Decoder(encoder->model, 30);
-    decoder_39 = new Decoder(encoder->model, 39);
-  }
+  MTrans(const char *cvimodel);
 
   ~MTrans() {
     delete encoder;
@@ -96,12 +80,15 @@ public:
     delete decoder_20;
     delete decoder_30;
     delete decoder_39;
+    CVI_NN_CleanupModel(model);
   }
 
   void run(int16_t *seq, int32_t seq_sz,
            int16_t *gen_seq, int32_t gen_seq_sz);
 
 private:
+  // all programs are loaded in one handle, sharing activation memory
+  CVI_MODEL_HANDLE model = nullptr;
   Encoder *encoder;
   Decoder *decoder_0;
   Decoder *decoder_10;
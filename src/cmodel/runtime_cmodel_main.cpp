@@ -810,6 +810,16 @@ CVI_RC CVI_RT_LoadCmdbufTee(CVI_RT_HANDLE rt_handle, uint8_t *cmdbuf, size_t sz,
   return CVI_SUCCESS;
 }
 
+CVI_RC CVI_RT_DupDmabufHeader(CVI_RT_HANDLE rt_handle, CVI_RT_MEM dmabuf_mem,
+                              CVI_RT_MEM *header_mem) {
+  (void)rt_handle;
+  (void)dmabuf_mem;
+  (void)header_mem;
+  // cmodel copies cmdbuf and sets base registers per run,
+  // the shared dmabuf is never modified.
+  return CVI_RC_UNSUPPORT;
+}
+
 CVI_RC CVI_RT_RunCmdbufTee(CVI_RT_HANDLE rt_handle, CVI_RT_MEM cmdbuf_mem,
                            CVI_RT_ARRAYBASE *p_array_base) {
   (void)rt_handle;
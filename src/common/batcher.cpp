@@ -0,0 +1,213 @@
+#include <string.h>
+#include <algorithm>
+#include <runtime/debug.h>
+#include <runtime/batcher.hpp>
+
+namespace cvi {
+namespace runtime {
+
+Batcher::Batcher(CviModel *model, int max_delay_us)
+    : _model(model), _max_delay(max_delay_us) {
+  _model->refer();
+}
+
+Batcher::~Batcher() {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done = true;
+    _cond.notify_all();
+  }
+  if (_worker.joinable()) {
+    _worker.join();
+  }
+  for (auto &bp : _programs) {
+    delete[] bp.inputs;
+    delete[] bp.outputs;
+    _model->unloadProgram(bp.program);
+  }
+  _model->release();
+}
+
+CVI_RC Batcher::addProgram(int program_id) {
+  BatchProgram bp;
+  CVI_RC ret = _model->loadProgram(&bp.program, program_id, false, false);
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+  bp.inputs = bp.program->exportInputs(bp.input_num);
+  bp.outputs = bp.program->exportOutputs(bp.output_num);
+  if (!bp.inputs || !bp.outputs) {
+    delete[] bp.inputs;
+    delete[] bp.outputs;
+    _model->unloadProgram(bp.program);
+    return CVI_RC_NOMEM;
+  }
+
+  // all tensors should be batched by dim 0 and have same
+  // sample size as other programs.
+  bp.batch = bp.inputs[0].shape.dim[0];
+  std::vector<size_t> in_sizes, out_sizes;
+  bool batched = true;
+  for (int i = 0; i < bp.input_num; ++i) {
+    auto &t = bp.inputs[i];
+    batched &= (t.shape.dim[0] == bp.batch && t.mem_size % bp.batch == 0);
+    in_sizes.push_back(t.mem_size / bp.batch);
+  }
+  for (int i = 0; i < bp.output_num; ++i) {
+    auto &t = bp.outputs[i];
+    batched &= (t.shape.dim[0] == bp.batch && t.mem_size % bp.batch == 0);
+    out_sizes.push_back(t.mem_size / bp.batch);
+  }
+  if (_input_sizes.empty()) {
+    _input_sizes = in_sizes;
+    _output_sizes = out_sizes;
+  }
+  bool duplicated = false;
+  for (auto &p : _programs) {
+    duplicated |= (p.batch == bp.batch);
+  }
+  if (!batched || duplicated || in_sizes != _input_sizes ||
+      out_sizes != _output_sizes) {
+    TPU_LOG_WARNING("program %d (batch %d) can't be used for batching\n",
+                    program_id, bp.batch);
+    delete[] bp.inputs;
+    delete[] bp.outputs;
+    _model->unloadProgram(bp.program);
+    return CVI_RC_UNSUPPORT;
+  }
+  _programs.push_back(bp);
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC Batcher::init() {
+  for (int i = 0; i < _model->program_num; ++i) {
+    CVI_RC ret = addProgram(i);
+    if (ret != CVI_RC_SUCCESS && ret != CVI_RC_UNSUPPORT) {
+      return ret;
+    }
+  }
+  if (_programs.empty()) {
+    TPU_LOG_ERROR("no program of model can be used for batching\n");
+    return CVI_RC_UNSUPPORT;
+  }
+  std::sort(_programs.begin(), _programs.end(),
+            [](const BatchProgram &a, const BatchProgram &b) {
+              return a.batch < b.batch;
+            });
+  for (auto &bp : _programs) {
+    TPU_LOG_INFO("batcher program batch:%d\n", bp.batch);
+  }
+  _worker = std::thread(&Batcher::workFunc, this);
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC Batcher::forward(CVI_TENSOR *inputs, int input_num,
+                        CVI_TENSOR *outputs, int output_num) {
+  if (input_num != (int)_input_sizes.size() ||
+      output_num != (int)_output_sizes.size()) {
+    TPU_LOG_ERROR("tensor num mismatch, input:%d, output:%d\n",
+                  input_num, output_num);
+    return CVI_RC_INVALID_ARG;
+  }
+  // each tensor must hold one sample, which is copied in or out as a whole.
+  for (int i = 0; i < input_num; ++i) {
+    if (inputs[i].mem_type != CVI_MEM_SYSTEM || !inputs[i].sys_mem ||
+        inputs[i].mem_size < _input_sizes[i]) {
+      return CVI_RC_INVALID_ARG;
+    }
+  }
+  for (int i = 0; i < output_num; ++i) {
+    if (outputs[i].mem_type != CVI_MEM_SYSTEM || !outputs[i].sys_mem ||
+        outputs[i].mem_size < _output_sizes[i]) {
+      return CVI_RC_INVALID_ARG;
+    }
+  }
+
+  Request req;
+  req.inputs = inputs;
+  req.outputs = outputs;
+  req.arrival = clock::now();
+  req.ret = CVI_RC_UNINIT;
+  req.done = false;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _queue.push_back(&req);
+  _cond.notify_all();
+  while (!req.done) {
+    req.cond.wait(lock);
+  }
+  return req.ret;
+}
+
+// Pick the largest batch that can be fully filled by pending
+// requests, or the smallest one if all batches are larger.
+Batcher::BatchProgram *Batcher::pickProgram(size_t pending) {
+  BatchProgram *bp = &_programs[0];
+  for (auto &p : _programs) {
+    if ((size_t)p.batch <= pending) {
+      bp = &p;
+    }
+  }
+  return bp;
+}
+
+CVI_RC Batcher::runBatch(BatchProgram &bp, std::vector<Request *> &reqs) {
+  for (size_t k = 0; k < reqs.size(); ++k) {
+    for (int i = 0; i < bp.input_num; ++i) {
+      auto sz = _input_sizes[i];
+      memcpy(bp.inputs[i].sys_mem + k * sz, reqs[k]->inputs[i].sys_mem, sz);
+    }
+  }
+  // unused samples of a partially filled batch are left as they are.
+  if (!bp.program->forward(bp.inputs, bp.input_num, bp.outputs, bp.output_num)) {
+    return CVI_RC_FAILURE;
+  }
+  for (size_t k = 0; k < reqs.size(); ++k) {
+    for (int i = 0; i < bp.output_num; ++i) {
+      auto sz = _output_sizes[i];
+      memcpy(reqs[k]->outputs[i].sys_mem, bp.outputs[i].sys_mem + k * sz, sz);
+    }
+  }
+  return CVI_RC_SUCCESS;
+}
+
+void Batcher::workFunc() {
+  size_t max_batch = _programs.back().batch;
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    while (_queue.empty() && !_done) {
+      _cond.wait(lock);
+    }
+    if (_queue.empty()) {
+      return;
+    }
+    // wait for more requests until the largest batch is filled
+    // or the oldest request has waited long enough.
+    auto deadline = _queue.front()->arrival + _max_delay;
+    while (_queue.size() < max_batch && !_done) {
+      if (_cond.wait_until(lock, deadline) == std::cv_status::timeout) {
+        break;
+      }
+    }
+
+    auto bp = pickProgram(_queue.size());
+    std::vector<Request *> reqs;
+    while (!_queue.empty() && (int)reqs.size() < bp->batch) {
+      reqs.push_back(_queue.front());
+      _queue.pop_front();
+    }
+
+    lock.unlock();
+    CVI_RC ret = runBatch(*bp, reqs);
+    lock.lock();
+
+    for (auto req : reqs) {
+      req->ret = ret;
+      req->done = true;
+      req->cond.notify_one();
+    }
+  }
+}
+
+} // namespace runtime
+} // namespace cvi
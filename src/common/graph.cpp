@@ -0,0 +1,113 @@
+#include <thread>
+#include <runtime/debug.h>
+#include <runtime/graph.hpp>
+
+namespace cvi {
+namespace runtime {
+
+int Graph::addNode(const task_t &run) {
+  _nodes.push_back({run, {}, {}});
+  return (int)_nodes.size() - 1;
+}
+
+CVI_RC Graph::addEdge(int from, int to, const task_t &transfer) {
+  if (from < 0 || to < 0 || from >= (int)_nodes.size() ||
+      to >= (int)_nodes.size() || from == to) {
+    return CVI_RC_INVALID_ARG;
+  }
+  auto &node = _nodes[from];
+  if (transfer) {
+    node.transfers.push_back(transfer);
+  }
+  node.succs.push_back(to);
+  return CVI_RC_SUCCESS;
+}
+
+std::vector<std::vector<int>> Graph::levels() {
+  std::vector<int> preds(_nodes.size(), 0);
+  for (auto &node : _nodes) {
+    for (auto succ : node.succs) {
+      preds[succ]++;
+    }
+  }
+  std::vector<std::vector<int>> levels;
+  std::vector<int> ready;
+  for (int i = 0; i < (int)_nodes.size(); ++i) {
+    if (preds[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+  size_t visited = 0;
+  while (!ready.empty()) {
+    visited += ready.size();
+    std::vector<int> next;
+    for (auto idx : ready) {
+      for (auto succ : _nodes[idx].succs) {
+        if (--preds[succ] == 0) {
+          next.push_back(succ);
+        }
+      }
+    }
+    levels.push_back(ready);
+    ready.swap(next);
+  }
+  if (visited != _nodes.size()) {
+    levels.clear();
+  }
+  return levels;
+}
+
+CVI_RC Graph::runNode(int idx) {
+  auto &node = _nodes[idx];
+  CVI_RC ret = node.run();
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+  for (auto &transfer : node.transfers) {
+    ret = transfer();
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+  }
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC Graph::run(bool parallel) {
+  auto groups = levels();
+  if (groups.empty() && !_nodes.empty()) {
+    TPU_LOG_ERROR("graph has cycle\n");
+    return CVI_RC_INVALID_ARG;
+  }
+  for (auto &group : groups) {
+    if (!parallel || group.size() == 1) {
+      for (auto idx : group) {
+        CVI_RC ret = runNode(idx);
+        if (ret != CVI_RC_SUCCESS) {
+          return ret;
+        }
+      }
+      continue;
+    }
+    // run first node on caller thread, others on workers.
+    std::vector<CVI_RC> rets(group.size(), CVI_RC_SUCCESS);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < group.size(); ++i) {
+      workers.emplace_back([this, &rets, &group, i]() {
+        rets[i] = runNode(group[i]);
+      });
+    }
+    rets[0] = runNode(group[0]);
+    for (auto &w : workers) {
+      w.join();
+    }
+    for (auto ret : rets) {
+      if (ret != CVI_RC_SUCCESS) {
+        return ret;
+      }
+    }
+  }
+  return CVI_RC_SUCCESS;
+}
+
+} // namespace runtime
+} // namespace cvi
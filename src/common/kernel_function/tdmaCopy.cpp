@@ -5,6 +5,10 @@
 #include <runtime/debug.h>
 #include <runtime/kernel_function.hpp>
 #include <inttypes.h>
+#include <map>
+#include <functional>
+#include <mutex>
+#include <string>
 
 namespace cvi {
 namespace runtime {
@@ -33,12 +37,29 @@ CVI_RC runtimeExecuteKernelFunction(CVI_RT_HANDLE ctx, CVI_RT_MEM codeBuf,
   return ret;
 }
 
-CVI_RT_MEM runtimeJitTdmaStrideCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
-                                    cvk_tg_shape_t *shapeDst,
-                                    cvk_tg_stride_t *strideDst,
-                                    cvk_tg_shape_t *shapeSrc,
-                                    cvk_tg_stride_t *strideSrc) {
-  auto cvkernel = (cvk_context_t *)cvk;
+CVI_RC runtimeExecuteGatherFunction(CVI_RT_HANDLE ctx, CVI_RT_MEM codeBuf,
+                                     const uint64_t *gaddrSrcs, int frames,
+                                     uint64_t gaddrDst) {
+  uint64_t baseArray[8] = {0};
+  baseArray[0] = gaddrDst;
+  for (int i = 0; i < frames; ++i) {
+    baseArray[i + 1] = gaddrSrcs[i];
+  }
+  CVI_RC ret = CVI_RT_RunCmdbufEx(
+      ctx, codeBuf, reinterpret_cast<CVI_RT_ARRAYBASE *>(baseArray));
+  if (ret != 0) {
+    TPU_LOG_WARNING("runtimeExecuteGatherFunction failed ret[%d]\n", ret);
+  }
+  return ret;
+}
+
+static void emitTdmaStrideCopy(cvk_context_t *cvkernel, CVI_FMT fmt,
+                               uint8_t dstReg, uint64_t dstAddr,
+                               cvk_tg_shape_t *shapeDst,
+                               cvk_tg_stride_t *strideDst,
+                               uint8_t srcReg,
+                               cvk_tg_shape_t *shapeSrc,
+                               cvk_tg_stride_t *strideSrc) {
   // programing with cvikernel intrinsic functions
   cvk_fmt_t cvk_fmt;
   if (fmt == CVI_FMT_INT8) {
@@ -50,7 +71,7 @@ CVI_RT_MEM runtimeJitTdmaStrideCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
   }
 
   cvk_tg_t src;
-  src.base_reg_index = 2;
+  src.base_reg_index = srcReg;
   src.start_address = 0;
   src.shape = *shapeSrc;
   if (strideSrc) {
@@ -61,8 +82,8 @@ CVI_RT_MEM runtimeJitTdmaStrideCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
   src.fmt = CVK_FMT_I8;
 
   cvk_tg_t dst;
-  dst.base_reg_index = 3;
-  dst.start_address = 0;
+  dst.base_reg_index = dstReg;
+  dst.start_address = dstAddr;
   dst.shape = *shapeDst;
   if (strideDst) {
     dst.stride = *strideDst;
@@ -76,10 +97,154 @@ CVI_RT_MEM runtimeJitTdmaStrideCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
   p.dst = &dst;
 
   cvkernel->ops->tdma_g2g_tensor_copy(cvkernel, &p);
+}
 
+CVI_RT_MEM runtimeJitTdmaStrideCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
+                                    cvk_tg_shape_t *shapeDst,
+                                    cvk_tg_stride_t *strideDst,
+                                    cvk_tg_shape_t *shapeSrc,
+                                    cvk_tg_stride_t *strideSrc) {
+  emitTdmaStrideCopy((cvk_context_t *)cvk, fmt, 3, 0, shapeDst, strideDst,
+                     2, shapeSrc, strideSrc);
   // do jit complilation
   return runtimeJitCompile(ctx, cvk);
 }
 
+// frame i is read from base reg i + 1, and written to base reg 0
+// at offset i * frameOffset, all in one cmdbuf.
+CVI_RT_MEM runtimeJitTdmaGatherCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
+                                    int frames, uint64_t frameOffset,
+                                    cvk_tg_shape_t *shapeDst,
+                                    cvk_tg_stride_t *strideDst,
+                                    cvk_tg_shape_t *shapeSrc,
+                                    cvk_tg_stride_t *strideSrc) {
+  assert(frames > 0 && frames <= TDMA_GATHER_MAX_FRAMES);
+  for (int i = 0; i < frames; ++i) {
+    emitTdmaStrideCopy((cvk_context_t *)cvk, fmt, 0, i * frameOffset,
+                       shapeDst, strideDst, i + 1, shapeSrc, strideSrc);
+  }
+  return runtimeJitCompile(ctx, cvk);
+}
+
+struct TdmaCopyEntry {
+  std::string key;
+  CVI_RT_MEM cmdbuf;
+  int refs;
+};
+
+static std::mutex gTdmaCopyLock;
+static std::map<std::string, TdmaCopyEntry *> gTdmaCopyCache;
+// handles given to callers, which are header copies of cached
+// cmdbuf, or the cmdbuf itself if header can't be duplicated.
+static std::multimap<CVI_RT_MEM, TdmaCopyEntry *> gTdmaCopyHandles;
+
+static std::string tdmaCopyKey(CVI_RT_HANDLE ctx, CVI_FMT fmt,
+                               cvk_tg_shape_t *shapeDst,
+                               cvk_tg_stride_t *strideDst,
+                               cvk_tg_shape_t *shapeSrc,
+                               cvk_tg_stride_t *strideSrc) {
+  // context is created for the target chip, so it stands for the chip.
+  char key[256];
+  int len = snprintf(key, sizeof(key), "%p:%d:%u,%u,%u,%u:%u,%u,%u,%u",
+                     ctx, (int)fmt, shapeDst->n, shapeDst->c, shapeDst->h,
+                     shapeDst->w, shapeSrc->n, shapeSrc->c, shapeSrc->h,
+                     shapeSrc->w);
+  // strides carry the alignment of vpss buffers, default if absent.
+  if (strideDst) {
+    len += snprintf(key + len, sizeof(key) - len, ":%u,%u,%u,%u", strideDst->n,
+                    strideDst->c, strideDst->h, strideDst->w);
+  } else {
+    len += snprintf(key + len, sizeof(key) - len, ":-");
+  }
+  if (strideSrc) {
+    snprintf(key + len, sizeof(key) - len, ":%u,%u,%u,%u", strideSrc->n,
+             strideSrc->c, strideSrc->h, strideSrc->w);
+  } else {
+    snprintf(key + len, sizeof(key) - len, ":-");
+  }
+  return key;
+}
+
+static CVI_RT_MEM acquireTdmaCopy(CVI_RT_HANDLE ctx, const std::string &key,
+                                  const std::function<CVI_RT_MEM()> &jit) {
+  const std::lock_guard<std::mutex> lock(gTdmaCopyLock);
+  TdmaCopyEntry *entry;
+  auto it = gTdmaCopyCache.find(key);
+  if (it != gTdmaCopyCache.end()) {
+    entry = it->second;
+  } else {
+    auto cmdbuf = jit();
+    if (!cmdbuf) {
+      return nullptr;
+    }
+    entry = new TdmaCopyEntry{key, cmdbuf, 0};
+    gTdmaCopyCache[key] = entry;
+  }
+  // base addresses are written into header on submission,
+  // so callers don't share the header of cmdbuf.
+  CVI_RT_MEM handle = nullptr;
+  if (CVI_RT_DupDmabufHeader(ctx, entry->cmdbuf, &handle) != CVI_RC_SUCCESS) {
+    handle = entry->cmdbuf;
+  }
+  entry->refs++;
+  gTdmaCopyHandles.emplace(handle, entry);
+  return handle;
+}
+
+CVI_RT_MEM runtimeAcquireTdmaStrideCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
+                                        cvk_tg_shape_t *shapeDst,
+                                        cvk_tg_stride_t *strideDst,
+                                        cvk_tg_shape_t *shapeSrc,
+                                        cvk_tg_stride_t *strideSrc) {
+  auto key = tdmaCopyKey(ctx, fmt, shapeDst, strideDst, shapeSrc, strideSrc);
+  return acquireTdmaCopy(ctx, key, [&]() {
+    return runtimeJitTdmaStrideCopy(ctx, cvk, fmt, shapeDst, strideDst,
+                                    shapeSrc, strideSrc);
+  });
+}
+
+CVI_RT_MEM runtimeAcquireTdmaGatherCopy(CVI_RT_HANDLE ctx, void *cvk, CVI_FMT fmt,
+                                        int frames, uint64_t frameOffset,
+                                        cvk_tg_shape_t *shapeDst,
+                                        cvk_tg_stride_t *strideDst,
+                                        cvk_tg_shape_t *shapeSrc,
+                                        cvk_tg_stride_t *strideSrc) {
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "gather:%d:%" PRIu64 ":", frames, frameOffset);
+  auto key = prefix + tdmaCopyKey(ctx, fmt, shapeDst, strideDst, shapeSrc, strideSrc);
+  return acquireTdmaCopy(ctx, key, [&]() {
+    return runtimeJitTdmaGatherCopy(ctx, cvk, fmt, frames, frameOffset, shapeDst,
+                                    strideDst, shapeSrc, strideSrc);
+  });
+}
+
+void runtimeReleaseTdmaStrideCopy(CVI_RT_HANDLE ctx, CVI_RT_MEM codeBuf,
+                                  bool discard) {
+  const std::lock_guard<std::mutex> lock(gTdmaCopyLock);
+  auto it = gTdmaCopyHandles.find(codeBuf);
+  if (it == gTdmaCopyHandles.end()) {
+    TPU_LOG_WARNING("release unknown tdma copy cmdbuf\n");
+    return;
+  }
+  auto entry = it->second;
+  gTdmaCopyHandles.erase(it);
+  if (codeBuf != entry->cmdbuf) {
+    CVI_RT_MemFree(ctx, codeBuf);
+  }
+  auto cached = gTdmaCopyCache.find(entry->key);
+  bool in_cache = (cached != gTdmaCopyCache.end() && cached->second == entry);
+  if (discard && in_cache) {
+    gTdmaCopyCache.erase(cached);
+    in_cache = false;
+  }
+  if (--entry->refs == 0) {
+    if (in_cache) {
+      gTdmaCopyCache.erase(cached);
+    }
+    CVI_RT_MemFree(ctx, entry->cmdbuf);
+    delete entry;
+  }
+}
+
 } // namespace runtime
 } // namespace cvi
\ No newline at end of file
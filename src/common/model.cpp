@@ -4,7 +4,13 @@
 #include <iostream>
 #include <sstream>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <set>
 #include <runtime/model.hpp>
+#include <runtime/model_cache.hpp>
 #include <runtime/stream.hpp>
 #include <runtime/debug.h>
 #include <runtime/version.h>
@@ -50,7 +56,7 @@ std::string CviModel::targetChipType = "";
 
 CviModel::CviModel(CVI_RT_HANDLE ctx, int count)
     : _ctx(ctx), ref(1), _count(count), _max_shared_mem_size(0) {
-  _pool = new TaskPool(1);
+  _pool = new TaskPool(TaskPool::getWorkerNum());
   if (std::getenv("TPU_ENABLE_PROTECT")) {
     isprotect = true;
   }
@@ -95,6 +101,8 @@ CviModel::CviModel(CVI_RT_HANDLE ctx, int count)
 CviModel::~CviModel() {
   if (_model_body)
     delete[] _model_body;
+  if (_stream)
+    delete _stream;
   if (_pool)
     delete _pool;
   if (_weight_mem) {
@@ -107,10 +115,7 @@ CviModel::~CviModel() {
     delete func;
   }
   for (auto buf : dmabuf_map) {
-    if (isprotect) {
-      mem_unprotect(CVI_RT_MemGetVAddr(buf.second), CVI_RT_MemGetSize(buf.second));
-    }
-    cviMemFree(_ctx, buf.second);
+    freeSectionMem(buf.second);
   }
 }
 
@@ -155,14 +160,24 @@ CVI_RC CviModel::parseModelHeader(BaseStream *stream, size_t &payload_sz, size_t
   }
 
   /* No chip field in heder before version 1.1 */
+  std::string target;
   if (header.major == 1 && header.minor == 0) {
-    targetChipType = "cv183x";
+    target = "cv183x";
   } else {
-    targetChipType = header.chip;
+    target = header.chip;
   }
-  if (!checkIfMatchTargetChipType(targetChipType)) {
+  if (!checkIfMatchTargetChipType(target)) {
     return CVI_RC_INVALID_ARG;
   }
+  {
+    // models may be parsed concurrently, all of them match the device,
+    // so the chip type is only set once.
+    static std::mutex chip_mutex;
+    const std::lock_guard<std::mutex> lock(chip_mutex);
+    if (targetChipType.empty()) {
+      targetChipType = target;
+    }
+  }
   // TODO, verify md5 here
   return CVI_RC_SUCCESS;
 }
@@ -201,18 +216,78 @@ void CviModel::parseProgramNum() {
   program_num = programs.size();
 
   _max_shared_mem_size = 0;
+  _max_private_mem_size = 0;
   for (int i = 0; i < program_num; ++i) {
     if (programs[i]->shared_gmem() > _max_shared_mem_size) {
       _max_shared_mem_size = programs[i]->shared_gmem();
     }
+    // old version cvimodel keeps all neurons in neuron_size
+    size_t private_size = std::max(programs[i]->neuron_size(),
+                                   programs[i]->private_gmem());
+    _max_private_mem_size = std::max(_max_private_mem_size, private_size);
   }
   TPU_LOG_INFO("Max SharedMem size:%zu\n", _max_shared_mem_size);
 }
 
+int CviModel::loadThreadNum = 0;
+
+void CviModel::setLoadThreadNum(int num) {
+  loadThreadNum = num;
+}
+
+static int getLoadThreadNum() {
+  if (CviModel::loadThreadNum > 0) {
+    return CviModel::loadThreadNum;
+  }
+  const char *env = std::getenv("TPU_LOAD_THREADS");
+  if (env && atoi(env) > 0) {
+    return atoi(env);
+  }
+  int num = (int)std::thread::hardware_concurrency();
+  return std::max(1, std::min(num, 4));
+}
+
+// run fn(0) .. fn(job_num - 1) on up to thread_num threads,
+// including the calling thread.
+static void parallelFor(int job_num, int thread_num,
+                        const std::function<void(int)> &fn) {
+  std::atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i = next++; i < job_num; i = next++) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < std::min(thread_num, job_num); ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+CVI_RC CviModel::readStream(BaseStream *stream, uint8_t *buf,
+                            size_t offset, size_t size) {
+  if (stream->read(buf, offset, size) != size) {
+    TPU_LOG_ERROR("failed to read model, offset:%zu size:%zu\n", offset, size);
+    return CVI_RC_DATA_ERR;
+  }
+  return CVI_RC_SUCCESS;
+}
+
+// time spent on decompression by current thread, it's excluded
+// from the time of the section being loaded.
+static thread_local uint64_t tls_decompress_us = 0;
+
+static bool readaheadEnabled() {
+  const char *env = std::getenv("TPU_ENABLE_READAHEAD");
+  return env && atoi(env) > 0;
+}
+
 CVI_RC CviModel::extractSections(BaseStream *stream, size_t bin_offset) {
   auto &sections = *_fb_model->sections();
-  std::vector<const cvi::model::Section*> cmdbuf_sections;
-  CVI_RC ret;
+  std::vector<const cvi::model::Section*> load_sections;
   for (auto s : sections) {
 #if __aarch64__
     if (s->type() == cvi::model::SectionType_FUNC_AARCH64) {
@@ -221,26 +296,124 @@ CVI_RC CviModel::extractSections(BaseStream *stream, size_t bin_offset) {
 #endif
       if (s->size() == 0)
         continue;
+      LoadTimer timer;
       if (!_custom_section.load(stream, s->offset() + bin_offset, s->size(),
                                 _cpu_functions)) {
         return CVI_RC_FAILURE;
       }
+      _load_profile.addPhase(CVI_LOAD_PHASE_CUSTOM_FUNC, timer.elapsed_us(), s->size());
     } else if (s->type() == cvi::model::SectionType_WEIGHT) {
-      ret = loadWeight(stream, s->offset() + bin_offset, s->size());
-      if (ret != CVI_RC_SUCCESS) {
-        return ret;
+      load_sections.emplace_back(s);
+    } else if (s->type() == cvi::model::SectionType_CMDBUF ||
+               s->type() == cvi::model::SectionType_DMABUF) {
+      if (_lazy_load) {
+        // loaded on demand by loadProgram()
+        _lazy_sections[s->name()->str()] = s;
+      } else {
+        load_sections.emplace_back(s);
       }
+    }
+  }
+  return loadSections(stream, bin_offset, load_sections);
+}
+
+void CviModel::recordSection(const cvi::model::Section *section, uint64_t time_us) {
+  time_us = (time_us > tls_decompress_us) ? time_us - tls_decompress_us : 0;
+  tls_decompress_us = 0;
+  uint64_t loaded_size = section->size();
+  if (section->compress() && section->decompressed_size()) {
+    loaded_size = section->decompressed_size();
+  }
+  auto phase = (section->type() == cvi::model::SectionType_WEIGHT) ?
+               CVI_LOAD_PHASE_WEIGHT : CVI_LOAD_PHASE_CMDBUF;
+  _load_profile.addPhase(phase, time_us, section->size());
+  _load_profile.addSection(section->name()->str(), (int32_t)section->type(),
+                           section->size(), loaded_size, time_us);
+}
+
+CVI_RC CviModel::loadSections(BaseStream *stream, size_t bin_offset,
+    const std::vector<const cvi::model::Section*> &sections) {
+  std::vector<const cvi::model::Section*> weight_sections;
+  std::vector<const cvi::model::Section*> dmabuf_sections;
+  std::vector<const cvi::model::Section*> cmdbuf_sections;
+  std::vector<const cvi::model::Section*> encrypt_sections;
+  CVI_RC ret;
+  for (auto s : sections) {
+    if (s->type() == cvi::model::SectionType_WEIGHT) {
+      weight_sections.emplace_back(s);
     } else if (s->type() == cvi::model::SectionType_CMDBUF) {
-      cmdbuf_sections.emplace_back(s);
-    } else if (s->type() == cvi::model::SectionType_DMABUF) {
-      ret = loadDmabuf(stream, s->offset() + bin_offset, s->size(), s);
-      if (ret != CVI_RC_SUCCESS) {
-        return ret;
+      // encrypted cmdbuf depends on the size of weight
+      if (s->encrypt()) {
+        encrypt_sections.emplace_back(s);
+      } else {
+        cmdbuf_sections.emplace_back(s);
       }
+    } else if (s->type() == cvi::model::SectionType_DMABUF) {
+      dmabuf_sections.emplace_back(s);
     }
   }
+
+  // sections are independent of each other, load them concurrently
+  // and insert the results in the same order as serial loading.
+  // streams are thread-safe, so workers read their sections directly.
+  struct SectionJob {
+    const cvi::model::Section *section;
+    CVI_RT_MEM mem;
+    CVI_RC ret;
+  };
+  std::vector<SectionJob> jobs;
+  for (auto s : weight_sections) {
+    jobs.push_back({s, nullptr, CVI_RC_SUCCESS});
+  }
+  for (auto s : dmabuf_sections) {
+    jobs.push_back({s, nullptr, CVI_RC_SUCCESS});
+  }
   for (auto s : cmdbuf_sections) {
-    ret = loadCmdbuf(stream, s->offset() + bin_offset, s->size(), s);
+    jobs.push_back({s, nullptr, CVI_RC_SUCCESS});
+  }
+  if (readaheadEnabled()) {
+    for (auto &job : jobs) {
+      stream->readahead(job.section->offset() + bin_offset, job.section->size());
+    }
+  }
+  parallelFor((int)jobs.size(), getLoadThreadNum(), [&](int i) {
+    auto &job = jobs[i];
+    auto s = job.section;
+    size_t offset = s->offset() + bin_offset;
+    tls_decompress_us = 0;
+    LoadTimer timer;
+    if (s->type() == cvi::model::SectionType_WEIGHT) {
+      job.ret = loadWeight(stream, offset, s->size());
+    } else if (s->type() == cvi::model::SectionType_DMABUF) {
+      job.ret = loadDmabuf(stream, offset, s->size(), s, &job.mem);
+    } else {
+      job.ret = loadCmdbuf(stream, offset, s->size(), s, &job.mem);
+    }
+    recordSection(s, timer.elapsed_us());
+  });
+
+  ret = CVI_RC_SUCCESS;
+  for (auto &job : jobs) {
+    if (job.mem) {
+      dmabuf_map.emplace(job.section->name()->str(), job.mem);
+    }
+    if (ret == CVI_RC_SUCCESS && job.ret != CVI_RC_SUCCESS) {
+      ret = job.ret;
+    }
+  }
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+
+  for (auto s : encrypt_sections) {
+    CVI_RT_MEM mem = nullptr;
+    tls_decompress_us = 0;
+    LoadTimer timer;
+    ret = loadCmdbuf(stream, s->offset() + bin_offset, s->size(), s, &mem);
+    recordSection(s, timer.elapsed_us());
+    if (mem) {
+      dmabuf_map.emplace(s->name()->str(), mem);
+    }
     if (ret != CVI_RC_SUCCESS) {
         return ret;
     }
@@ -248,36 +421,72 @@ CVI_RC CviModel::extractSections(BaseStream *stream, size_t bin_offset) {
   return CVI_RC_SUCCESS;
 }
 
-CVI_RC CviModel::loadDmabuf(BaseStream *stream, size_t offset, size_t size, const cvi::model::Section *section) {
+#ifdef ENABLE_COMPRESS_CMDBUF
+// Decompress a LZ4 compressed section into dst. The compressed bytes are
+// taken from the stream in place if it's memory backed, otherwise they are
+// staged in a host buffer, never in device memory.
+CVI_RC CviModel::decompressSection(BaseStream *stream, size_t offset, size_t size,
+                                   uint8_t *dst, size_t dst_size) {
+  std::vector<uint8_t> staging;
+  const uint8_t *src = stream->data(offset, size);
+  if (!src) {
+    staging.resize(size);
+    CVI_RC ret = readStream(stream, staging.data(), offset, size);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+    src = staging.data();
+  }
+  LoadTimer timer;
+  int rc = LZ4_decompress_safe(reinterpret_cast<const char *>(src),
+                               reinterpret_cast<char *>(dst),
+                               (int)size, (int)dst_size);
+  uint64_t time_us = timer.elapsed_us();
+  tls_decompress_us += time_us;
+  _load_profile.addPhase(CVI_LOAD_PHASE_DECOMPRESS, time_us, dst_size);
+  if (rc < 0 || (size_t)rc != dst_size) {
+    TPU_LOG_ERROR("decompress error, rc:%d, expect:%zu\n", rc, dst_size);
+    return CVI_RC_DATA_ERR;
+  }
+  return CVI_RC_SUCCESS;
+}
+#endif
+
+CVI_RC CviModel::loadDmabuf(BaseStream *stream, size_t offset, size_t size,
+                            const cvi::model::Section *section, CVI_RT_MEM *mem) {
   if (section->encrypt()) {
     assert(0 && "TODO encrypt");
   }
-  CVI_RT_MEM buf = cviMemAlloc(_ctx, size, CVI_ALLOC_DMABUF, _model_name.c_str());
+  bool compressed = section->compress() && section->decompressed_size() > 0;
+#ifndef ENABLE_COMPRESS_CMDBUF
+  if (compressed) {
+    TPU_LOG_ERROR("Compressed dmabuf is not supported! please recompile with ENABLE_COMPRESS_CMDBUF\n");
+    return CVI_RC_UNSUPPORT;
+  }
+#endif
+  // compressed section is decompressed straight into the final buffer,
+  // so only the decompressed size is allocated from device memory.
+  size_t length = compressed ? section->decompressed_size() : size;
+  CVI_RT_MEM buf = cviMemAlloc(_ctx, length, CVI_ALLOC_DMABUF, _model_name.c_str());
   if (!buf) {
-    TPU_LOG_ERROR("alloc memory for dmabuf failed, size:%zu\n", size);
+    TPU_LOG_ERROR("alloc memory for dmabuf failed, size:%zu\n", length);
     return CVI_RC_NOMEM;
   }
-  stream->read(CVI_RT_MemGetVAddr(buf), offset, size);
-  size_t length = size;
-  if (section->compress() && section->decompressed_size() > 0) {
+  if (compressed) {
 #ifdef ENABLE_COMPRESS_CMDBUF
-    auto tmp_buf = cviMemAlloc(_ctx, section->decompressed_size(), CVI_ALLOC_DMABUF, _model_name.c_str());
-    if (!tmp_buf) {
-        TPU_LOG_ERROR("alloc memory for decompressed dmabuf failed, size:%zu\n", size);
-        cviMemFree(_ctx, buf);
-        return false;
-    }
-    size_t rc = LZ4_decompress_safe(reinterpret_cast<char *>(CVI_RT_MemGetVAddr(buf)),
-                                    reinterpret_cast<char *>(CVI_RT_MemGetVAddr(tmp_buf)),
-                                    size, section->decompressed_size());
-    TPU_ASSERT(rc == section->decompressed_size(), "decompress error rc != decompressed size");
-    cviMemFree(_ctx, buf);
-    buf = tmp_buf;
-    length = section->decompressed_size();
-#else
-    TPU_LOG_ERROR("Compressed dmabuf is not supported! please recompile with ENABLE_COMPRESS_CMDBUF\n");
-    return CVI_RC_UNSUPPORT;
+    CVI_RC ret = decompressSection(stream, offset, size,
+                                   CVI_RT_MemGetVAddr(buf), length);
+    if (ret != CVI_RC_SUCCESS) {
+      cviMemFree(_ctx, buf);
+      return ret;
+    }
 #endif
+  } else {
+    CVI_RC ret = readStream(stream, CVI_RT_MemGetVAddr(buf), offset, size);
+    if (ret != CVI_RC_SUCCESS) {
+      cviMemFree(_ctx, buf);
+      return ret;
+    }
   }
 
   bool enable_pmu = false;
@@ -300,19 +509,28 @@ CVI_RC CviModel::loadDmabuf(BaseStream *stream, size_t offset, size_t size, cons
     cviMemFree(_ctx, buf);
   }
 
-  dmabuf_map.emplace(section->name()->str(), cmdbuf_mem);
+  *mem = cmdbuf_mem;
   return CVI_RC_SUCCESS;
 }
 
-CVI_RC CviModel::loadCmdbuf(BaseStream *stream, size_t offset, size_t size, const cvi::model::Section *section) {
+CVI_RC CviModel::loadCmdbuf(BaseStream *stream, size_t offset, size_t size,
+                            const cvi::model::Section *section, CVI_RT_MEM *mem) {
   //assert(size && _weight_mem); // load cmdbuf must behind load weight
   if (0 == size) {
     return CVI_RC_SUCCESS;
   }
-  std::vector<uint8_t> cmdbuf(size);
+  bool compressed = section->compress() && section->decompressed_size();
+  std::vector<uint8_t> cmdbuf;
   bool enable_pmu = false;
 
-  stream->read(cmdbuf.data(), offset, size);
+  // compressed bytes are fed to the decompressor from the stream directly
+  if (!compressed || section->encrypt()) {
+    cmdbuf.resize(size);
+    CVI_RC ret = readStream(stream, cmdbuf.data(), offset, size);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+  }
 
 #ifdef ENABLE_PMU
   const char *pmu_enable_env = std::getenv("TPU_ENABLE_PMU");
@@ -330,15 +548,20 @@ CVI_RC CviModel::loadCmdbuf(BaseStream *stream, size_t offset, size_t size, cons
     ret = CVI_RT_LoadCmdbufTee(_ctx, cmdbuf.data(), size, 0,
                                0, weight_size, &cmdbuf_mem);
   } else {
-    if (section->compress() && section->decompressed_size()) {
+    if (compressed) {
 #ifdef ENABLE_COMPRESS_CMDBUF
+      // raw cmdbuf is converted into a dmabuf by CVI_RT_LoadCmdbuf, so it
+      // can't be decompressed into device memory directly. For streams not
+      // memory backed, compressed bytes are staged as well, peak host memory
+      // is compressed + decompressed size.
       uint8_t *buf = new(std::nothrow) uint8_t[section->decompressed_size()];
       TPU_ASSERT(buf != nullptr, "Allocate decompress buff failed");
-
-      size_t rc = LZ4_decompress_safe(reinterpret_cast<char *>(cmdbuf.data()),
-                                      reinterpret_cast<char *>(buf),
-                                      size, section->decompressed_size());
-      TPU_ASSERT(rc == section->decompressed_size(), "decompress error rc != decompressed size");
+      ret = decompressSection(stream, offset, size, buf,
+                              section->decompressed_size());
+      if (ret != CVI_RC_SUCCESS) {
+        delete[] buf;
+        return ret;
+      }
 
       ret = CVI_RT_LoadCmdbuf(
           _ctx, buf, section->decompressed_size(), 0,
@@ -356,11 +579,11 @@ CVI_RC CviModel::loadCmdbuf(BaseStream *stream, size_t offset, size_t size, cons
           0, enable_pmu, &cmdbuf_mem);
     }
   }
-  if (ret == CVI_RC_SUCCESS) {
-    dmabuf_map.emplace(section->name()->str(), cmdbuf_mem);
-  } else {
+  if (ret != CVI_RC_SUCCESS) {
     TPU_LOG_WARNING("loadCmdbuf failed\n");
+    return ret;
   }
+  *mem = cmdbuf_mem;
   if (isprotect) {
     mem_protect(CVI_RT_MemGetVAddr(cmdbuf_mem), CVI_RT_MemGetSize(cmdbuf_mem));
   }
@@ -382,7 +605,10 @@ CVI_RC CviModel::loadWeight(BaseStream *stream, size_t offset, size_t size) {
     TPU_LOG_ERROR("alloc memory for weight failed, size:%zu\n", size);
     return CVI_RC_NOMEM;
   }
-  stream->read(CVI_RT_MemGetVAddr(_weight_mem), offset, size);
+  CVI_RC ret = readStream(stream, CVI_RT_MemGetVAddr(_weight_mem), offset, size);
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
   CVI_RT_MemFlush(_ctx, _weight_mem);
   if (isprotect) {
     mem_protect(CVI_RT_MemGetVAddr(_weight_mem), alloc_size);
@@ -406,6 +632,7 @@ void CviModel::createCpuWeightMap() {
 
 CVI_RC CviModel::parse(BaseStream *stream) {
   CVI_RC ret;
+  LoadTimer timer;
   size_t payload_size;
   size_t header_size;
   ret = parseModelHeader(stream, payload_size, header_size);
@@ -413,61 +640,228 @@ CVI_RC CviModel::parse(BaseStream *stream) {
     return ret;
   }
   size_t bin_offset = header_size + payload_size;
-  _model_body = new uint8_t[payload_size];
-  if (!_model_body) {
-    TPU_LOG_ERROR("Failed to allocate memory\n");
-    return CVI_RC_NOMEM;
+  const uint8_t *body = stream->data(header_size, payload_size);
+  if (body) {
+    // parse flatbuffer in place, the stream must outlive the model
+    _stream = stream;
+  } else {
+    _model_body = new uint8_t[payload_size];
+    if (!_model_body) {
+      TPU_LOG_ERROR("Failed to allocate memory\n");
+      return CVI_RC_NOMEM;
+    }
+    ret = readStream(stream, _model_body, header_size, payload_size);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+    body = _model_body;
   }
-  stream->read(_model_body, header_size, payload_size);
 
-  _fb_model = (cvi::model::Model *)cvi::model::GetModel(_model_body);
+  _fb_model = (cvi::model::Model *)cvi::model::GetModel(body);
   ret = showAndCheckVersion();
   if (ret != CVI_RC_SUCCESS) {
     return ret;
   }
+  _load_profile.addPhase(CVI_LOAD_PHASE_PARSE, timer.elapsed_us(),
+                         header_size + payload_size);
 
   std::stringstream model_name;
   model_name << _fb_model->name()->str() << ":" << _count;
   _model_name = model_name.str();
 
+  // only worth deferring if programs may not all be used
+  _lazy_load = _lazy_load && _fb_model->programs()->size() > 1;
+  if (_lazy_load) {
+    _stream = stream;
+    _bin_offset = bin_offset;
+  }
   ret = extractSections(stream, bin_offset);
   if (ret != CVI_RC_SUCCESS) {
     return ret;
   }
 
   parseProgramNum();
+  timer = LoadTimer();
   createCpuWeightMap();
+  _load_profile.addPhase(CVI_LOAD_PHASE_CPU_WEIGHT_MAP, timer.elapsed_us(), 0);
 
   return CVI_RC_SUCCESS;
 }
 
+// names of cmdbuf/dmabuf sections used by a program
+static std::set<std::string> programSections(const cvi::model::Program *fb_program) {
+  std::set<std::string> names;
+  for (auto r : *fb_program->routines()) {
+    if (r->type() != cvi::model::RoutineType_TPU) {
+      continue;
+    }
+    if (r->tpu_routine()->cmdbuf_section()) {
+      names.insert(r->tpu_routine()->cmdbuf_section()->str());
+    } else if (r->tpu_routine()->dmabuf_section()) {
+      names.insert(r->tpu_routine()->dmabuf_section()->str());
+    }
+  }
+  return names;
+}
+
+CVI_RC CviModel::acquireProgramSections(const cvi::model::Program *fb_program) {
+  std::vector<const cvi::model::Section*> sections;
+  for (auto &name : programSections(fb_program)) {
+    auto it = _lazy_sections.find(name);
+    if (it == _lazy_sections.end()) {
+      continue;
+    }
+    if (_section_refs[name]++ == 0) {
+      sections.emplace_back(it->second);
+    }
+  }
+  if (sections.empty()) {
+    return CVI_RC_SUCCESS;
+  }
+  TPU_LOG_DEBUG("load %zu sections on demand\n", sections.size());
+  CVI_RC ret = loadSections(_stream, _bin_offset, sections);
+  if (ret != CVI_RC_SUCCESS) {
+    releaseProgramSections(fb_program);
+  }
+  return ret;
+}
+
+void CviModel::releaseProgramSections(const cvi::model::Program *fb_program) {
+  for (auto &name : programSections(fb_program)) {
+    auto ref_it = _section_refs.find(name);
+    if (ref_it == _section_refs.end() || --ref_it->second > 0) {
+      continue;
+    }
+    _section_refs.erase(ref_it);
+    auto it = dmabuf_map.find(name);
+    if (it != dmabuf_map.end()) {
+      freeSectionMem(it->second);
+      dmabuf_map.erase(it);
+    }
+  }
+}
+
+void CviModel::freeSectionMem(CVI_RT_MEM mem) {
+  if (isprotect) {
+    mem_unprotect(CVI_RT_MemGetVAddr(mem), CVI_RT_MemGetSize(mem));
+  }
+  cviMemFree(_ctx, mem);
+}
+
+void CviModel::unloadProgram(Program *program) {
+  if (!_lazy_load) {
+    delete program;
+    return;
+  }
+  // the entry is dropped before program is freed, or a concurrent
+  // loadProgram may get the same address and have its entry erased.
+  std::lock_guard<std::mutex> lock(_section_mutex);
+  int program_id = -1;
+  auto it = _program_ids.find(program);
+  if (it != _program_ids.end()) {
+    program_id = it->second;
+    _program_ids.erase(it);
+  }
+  // routines of program refer the sections, release them afterwards.
+  delete program;
+  if (program_id >= 0) {
+    releaseProgramSections((*_fb_model->programs())[program_id]);
+  }
+}
+
 CVI_RC CviModel::loadProgram(Program **program,
                              int program_id,
                              bool export_all_tensors,
-                             bool skip_preprocess) {
+                             bool skip_preprocess,
+                             CVI_RT_MEM private_mem) {
   CVI_RC ret;
   auto &programs = *_fb_model->programs();
   assert(program_id < program_num);
   auto fb_program = programs[program_id];
+  LoadTimer timer;
+  // dmabuf_map is modified by lazy loading
+  std::lock_guard<std::mutex> lock(_section_mutex);
+  if (_lazy_load) {
+    ret = acquireProgramSections(fb_program);
+    if (ret != CVI_RC_SUCCESS) {
+      *program = nullptr;
+      return ret;
+    }
+  }
   auto ptr = new Program(_ctx, _pool, dmabuf_map,
                           _cpu_functions, weight_map,
                           _weight_mem, _model_name.c_str(), _max_shared_mem_size);
   if (!ptr) {
     TPU_LOG_ERROR("Failed to create a Program instance\n");
+    if (_lazy_load) {
+      releaseProgramSections(fb_program);
+    }
     return CVI_RC_FAILURE;
   }
   ptr->setOptions(export_all_tensors, skip_preprocess);
+  if (private_mem) {
+    ptr->setPrivateMem(private_mem);
+  }
   ret = ptr->load(fb_program);
   if (ret != CVI_RC_SUCCESS) {
     TPU_LOG_ERROR("program load failed:%d\n", ret);
     delete ptr;
+    if (_lazy_load) {
+      releaseProgramSections(fb_program);
+    }
     *program = nullptr;
     return ret;
   }
+  if (_lazy_load) {
+    _program_ids[ptr] = program_id;
+  }
+  // programs belong to the handle, not to the shared CviModel,
+  // so their load time is kept in the program itself.
+  ptr->load_time_us = timer.elapsed_us();
   *program = ptr;
   return CVI_RC_SUCCESS;
 }
 
+CVI_RC CviModel::loadAllPrograms(std::vector<Program *> &programs,
+                                 bool export_all_tensors,
+                                 bool skip_preprocess,
+                                 CVI_RT_MEM *private_mem) {
+  *private_mem = nullptr;
+  if (_max_private_mem_size) {
+    *private_mem = cviMemAlloc(_ctx, _max_private_mem_size, CVI_ALLOC_PROGRAM,
+                               _model_name.c_str());
+    if (!*private_mem) {
+      TPU_LOG_ERROR("failed to alloc private gmem: %zu\n", _max_private_mem_size);
+      return CVI_RC_NOMEM;
+    }
+  }
+  for (int i = 0; i < program_num; ++i) {
+    Program *program = nullptr;
+    CVI_RC ret = loadProgram(&program, i, export_all_tensors,
+                             skip_preprocess, *private_mem);
+    if (ret != CVI_RC_SUCCESS) {
+      unloadAllPrograms(programs, *private_mem);
+      *private_mem = nullptr;
+      return ret;
+    }
+    programs.push_back(program);
+  }
+  TPU_LOG_INFO("%d programs share private gmem:%zu\n", program_num,
+               _max_private_mem_size);
+  return CVI_RC_SUCCESS;
+}
+
+void CviModel::unloadAllPrograms(std::vector<Program *> &programs,
+                                 CVI_RT_MEM private_mem) {
+  for (auto program : programs) {
+    unloadProgram(program);
+  }
+  programs.clear();
+  if (private_mem) {
+    cviMemFree(_ctx, private_mem);
+  }
+}
+
 std::string CviModel::getChipType(
     const std::string &modelFile,
     const int8_t *buf, size_t size) {
@@ -489,24 +883,36 @@ std::string CviModel::getChipType(
   return std::string(header.chip);
 }
 
-CVI_RC CviModel::acquire(const int8_t *buf, size_t size) {
-  BaseStream *stream = new BufferStream(buf, size);
+CVI_RC CviModel::acquire(BaseStream *stream) {
+  LoadTimer timer;
   CVI_RC ret = this->parse(stream);
+  _load_profile.addTotal(timer.elapsed_us());
   if (ret != CVI_RC_SUCCESS) {
     TPU_LOG_ERROR("failed to parse cvimodel\n");
   }
-  delete stream;
+  if (stream != _stream) {
+    delete stream;
+  }
   return ret;
 }
 
-CVI_RC CviModel::acquire(const std::string &modelFile) {
-  BaseStream *stream = new FileStream(modelFile);
-  CVI_RC ret = this->parse(stream);
-  if (ret != CVI_RC_SUCCESS) {
-    TPU_LOG_ERROR("failed to parse cvimodel\n");
+CVI_RC CviModel::acquire(const int8_t *buf, size_t size) {
+  return acquire(new BufferStream(buf, size));
+}
+
+CVI_RC CviModel::acquire(const std::string &modelFile, bool use_mmap,
+                         bool lazy_load) {
+  // the file stream can be kept to load sections later
+  _lazy_load = lazy_load;
+  if (use_mmap) {
+    BaseStream *stream = new MmapStream(modelFile);
+    if (stream->length()) {
+      return acquire(stream);
+    }
+    delete stream;
+    TPU_LOG_WARNING("mmap %s failed, fallback to read\n", modelFile.c_str());
   }
-  delete stream;
-  return ret;
+  return acquire(new FileStream(modelFile));
 }
 
 /*
@@ -514,18 +920,23 @@ fd:The file descriptor
 ud_offset:The file header offset defined by the user.
 */
 CVI_RC CviModel::acquire(const int fd, const size_t ud_offset) {
-  BaseStream *stream = new FdStream(fd, ud_offset);
-  CVI_RC ret = this->parse(stream);
-  if (ret != CVI_RC_SUCCESS) {
-    TPU_LOG_ERROR("failed to parse cvimodel\n");
+  return acquire(new FdStream(fd, ud_offset));
+}
+
+// refer the model only if it's still alive, used by model cache.
+bool CviModel::tryRefer() {
+  int32_t cur = ref.load();
+  while (cur > 0) {
+    if (ref.compare_exchange_weak(cur, cur + 1)) {
+      return true;
+    }
   }
-  delete stream;
-  return ret;
+  return false;
 }
 
 void CviModel::release() {
-  --ref;
-  if (ref == 0) {
+  if (--ref == 0) {
+    removeCachedModel(this);
     delete this;
   }
 }
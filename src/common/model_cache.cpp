@@ -0,0 +1,119 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <condition_variable>
+#include <runtime/debug.h>
+#include <runtime/model_cache.hpp>
+#include <runtime/hash.hpp>
+
+namespace cvi {
+namespace runtime {
+
+static std::mutex gCacheLock;
+static std::map<std::string, CviModel *> gModelCache;
+// keys of models being loaded, registrants of them wait on gCacheCond.
+static std::set<std::string> gPendingKeys;
+static std::condition_variable gCacheCond;
+
+static std::string keyOfStat(const struct stat &st, size_t offset) {
+  std::stringstream ss;
+  ss << "file:" << st.st_dev << ":" << st.st_ino << ":" << st.st_size << ":"
+     << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec << ":" << offset;
+  return ss.str();
+}
+
+std::string modelCacheKeyOfFile(const char *file) {
+  struct stat st;
+  if (!file || stat(file, &st) != 0) {
+    return "";
+  }
+  return keyOfStat(st, 0);
+}
+
+std::string modelCacheKeyOfFd(int fd, size_t ud_offset) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return "";
+  }
+  return keyOfStat(st, ud_offset);
+}
+
+// Only the head and tail of buffer are hashed, so that a cache miss
+// doesn't read the whole model. The cvimodel header, which carries the
+// md5 of the model, is part of the key and is compared on every lookup.
+std::string modelCacheKeyOfBuffer(const int8_t *buf, size_t size) {
+  const size_t hash_len = 1024 * 1024;
+  if (size <= sizeof(MODEL_HEADER)) {
+    return "";
+  }
+  std::stringstream ss;
+  ss << "buf:" << size << ":" << std::hex;
+  if (size <= 2 * hash_len) {
+    ss << contentHash(buf, size) << ":";
+  } else {
+    ss << contentHash(buf, hash_len) << ":"
+       << contentHash(buf + size - hash_len, hash_len) << ":";
+  }
+  auto header = (const uint8_t *)buf;
+  for (size_t i = 0; i < sizeof(MODEL_HEADER); ++i) {
+    ss << (int)(header[i] >> 4) << (int)(header[i] & 0xf);
+  }
+  return ss.str();
+}
+
+bool modelCacheEnabled() {
+  const char *env = std::getenv("TPU_DISABLE_MODEL_CACHE");
+  return !(env && atoi(env) > 0);
+}
+
+CviModel *lookupCachedModel(const std::string &key) {
+  std::unique_lock<std::mutex> lock(gCacheLock);
+  while (true) {
+    auto it = gModelCache.find(key);
+    // model may be in the middle of its last release
+    if (it != gModelCache.end() && it->second->tryRefer()) {
+      TPU_LOG_DEBUG("share cached model %s\n", key.c_str());
+      return it->second;
+    }
+    if (!gPendingKeys.count(key)) {
+      break;
+    }
+    // loaded by another registrant, refer it once published
+    gCacheCond.wait(lock);
+  }
+  gPendingKeys.insert(key);
+  return nullptr;
+}
+
+void insertCachedModel(const std::string &key, CviModel *model) {
+  const std::lock_guard<std::mutex> lock(gCacheLock);
+  gModelCache[key] = model;
+  gPendingKeys.erase(key);
+  gCacheCond.notify_all();
+}
+
+void abandonCachedModel(const std::string &key) {
+  const std::lock_guard<std::mutex> lock(gCacheLock);
+  gPendingKeys.erase(key);
+  gCacheCond.notify_all();
+}
+
+void removeCachedModel(CviModel *model) {
+  const std::lock_guard<std::mutex> lock(gCacheLock);
+  for (auto it = gModelCache.begin(); it != gModelCache.end(); ++it) {
+    if (it->second == model) {
+      gModelCache.erase(it);
+      return;
+    }
+  }
+}
+
+} // namespace runtime
+} // namespace cvi
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <sstream>
 #include <mutex>
+#include <algorithm>
 #include <runtime/debug.h>
 #include "cviruntime.h"
 #include <runtime/model.hpp>
@@ -198,15 +199,19 @@ Neuron::Neuron(
 }
 
 Neuron::~Neuron() {
+  for (auto &kv : _shared_gmems) {
+    if (kv.second != _gmem)
+      cviMemFree(_ctx, kv.second);
+  }
   if (_gmem)
     cviMemFree(_ctx, _gmem);
-  if (_channelPreloadCmdbuf)
-    CVI_RT_MemFree(_ctx, _channelPreloadCmdbuf);
-  if (_framePreloadCmdbuf)
-    CVI_RT_MemFree(_ctx, _framePreloadCmdbuf);
+  for (auto &kv : _channelGatherCmdbufs)
+    runtimeReleaseTdmaStrideCopy(_ctx, kv.second);
+  for (auto &kv : _frameGatherCmdbufs)
+    runtimeReleaseTdmaStrideCopy(_ctx, kv.second);
   if (_streamCopyCmdbuf)
-    CVI_RT_MemFree(_ctx, _streamCopyCmdbuf);
-  if (_cpu_mem)
+    runtimeReleaseTdmaStrideCopy(_ctx, _streamCopyCmdbuf);
+  if (_cpu_mem && _cpu_mem_owned)
     free(_cpu_mem);
 }
 
@@ -286,123 +291,138 @@ bool Neuron::isPacked() {
   return false;
 }
 
-// preload cahnnel's data from vpss buffer, which w dimension is aligned by vpss_w_align.
-// we need copy and unalign the data to compactly tensor using TDMA.
-CVI_RC Neuron::preloadChannelAndCompact(int32_t channel_idx, uint64_t src_paddr) {
-  uint32_t h, w;
+void Neuron::channelShape(uint32_t &c, uint32_t &h, uint32_t &w) {
   if (isPacked()) {
+    c = 1;
     h = shape[1];
     w = shape[2] * shape[3];
   } else {
+    c = shape[1];
     h = shape[2];
     w = shape[3];
   }
-  CVI_RC ret = CVI_RC_SUCCESS;
-  for (int i = 0; i < 3; ++i) {
-      if (!_channelPreloadCmdbuf) {
-          uint32_t hstride           = align_up(w, vpss_w_align);
-          cvk_tg_shape_t tg_shape    = {1, 1, h, w};
-          cvk_tg_stride_t src_stride = {1, 1, hstride, 1};
-          cvk_tg_stride_t dst_stride = {1, 1, w, 1};
-          _channelPreloadCmdbuf      = runtimeJitTdmaStrideCopy(
-                   _ctx, _cvk, fmt, &tg_shape,
-                   &dst_stride, &tg_shape, &src_stride);
-          if (!_channelPreloadCmdbuf) {
-              continue;
-          }
-      }
-      ret = runtimeExecuteKernelFunction(
-          _ctx, _channelPreloadCmdbuf, src_paddr,
-          _paddr + channel_idx * h * w);
-      if (ret != CVI_RC_SUCCESS) {
-          TPU_LOG_ERROR("preloadChannelAndCompact fail!ret:%d", ret);
-          CVI_RT_MemFree(_ctx, _channelPreloadCmdbuf);
-          _channelPreloadCmdbuf = nullptr;
-      } else {
-          return CVI_RC_SUCCESS;
-      }
-  }
-  return ret;
 }
 
-// preload frame's data from vpss buffer
-// we need copy and unalign the data to compactly tensor using TDMA.
-CVI_RC Neuron::preloadFrameAndCompact(int32_t frame_idx, uint64_t src_paddr) {
-  uint32_t c, h, w;
-  if (isPacked()) {
-    c = 1;
-    h = shape[1];
-    w = shape[2] * shape[3];
+// cmdbuf gathering num channels or frames of vpss buffers into neuron,
+// offset is the distance of two channels or frames in neuron.
+CVI_RT_MEM Neuron::jitGather(bool channel, int num, uint64_t &offset) {
+  CVI_RT_MEM cmdbuf = nullptr;
+  if (!channel && aligned) {
+    // just copy vpss data to neuron and
+    // keep w and frame dimensions's alignment.
+    uint32_t frame_size = align_up(_size / shape[0], vpss_w_align);
+    offset = frame_size;
+    auto it = _frameGatherCmdbufs.find(num);
+    if (it != _frameGatherCmdbufs.end()) {
+      return it->second;
+    }
+    cvk_tg_shape_t tg_shape = {1, 1, frame_size / vpss_w_align, (uint32_t)vpss_w_align};
+    cmdbuf = runtimeAcquireTdmaGatherCopy(
+        _ctx, _cvk, CVI_FMT_INT8, num, offset,
+        &tg_shape, nullptr, &tg_shape, nullptr);
   } else {
-    c = shape[1];
-    h = shape[2];
-    w = shape[3];
+    // w dimension of vpss buffer is aligned by vpss_w_align,
+    // copy and unalign the data to compactly tensor.
+    uint32_t c, h, w;
+    channelShape(c, h, w);
+    uint32_t hstride = align_up(w, vpss_w_align);
+    cvk_tg_shape_t tg_shape;
+    cvk_tg_stride_t src_stride, dst_stride;
+    if (channel) {
+      tg_shape   = {1, 1, h, w};
+      src_stride = {1, 1, hstride, 1};
+      dst_stride = {1, 1, w, 1};
+      offset     = h * w;
+    } else {
+      tg_shape   = {1, c, h, w};
+      src_stride = {1, h * hstride, hstride, 1};
+      dst_stride = {1, h * w, w, 1};
+      offset     = c * h * w;
+    }
+    auto &cmdbufs = channel ? _channelGatherCmdbufs : _frameGatherCmdbufs;
+    auto it = cmdbufs.find(num);
+    if (it != cmdbufs.end()) {
+      return it->second;
+    }
+    cmdbuf = runtimeAcquireTdmaGatherCopy(
+        _ctx, _cvk, fmt, num, offset,
+        &tg_shape, &dst_stride, &tg_shape, &src_stride);
   }
-  CVI_RC ret = CVI_RC_SUCCESS;
-  for (int i = 0; i < 3; ++i) {
-      if (!_framePreloadCmdbuf) {
-          uint32_t hstride           = align_up(w, vpss_w_align);
-          cvk_tg_shape_t tg_shape    = {1, c, h, w};
-          cvk_tg_stride_t src_stride = {1, h * hstride, hstride, 1};
-          cvk_tg_stride_t dst_stride = {1, h * w, w, 1};
-          _framePreloadCmdbuf        = runtimeJitTdmaStrideCopy(
-                     _ctx, _cvk, fmt, &tg_shape,
-                     &dst_stride, &tg_shape, &src_stride);
-          if (!_framePreloadCmdbuf) {
-              continue;
-          }
-      }
-      ret = runtimeExecuteKernelFunction(
-          _ctx, _framePreloadCmdbuf, src_paddr,
-          _paddr + frame_idx * c * h * w);
-      if (ret != CVI_RC_SUCCESS) {
-          TPU_LOG_ERROR("preloadFrameAndCompact fail!ret:%d", ret);
-          CVI_RT_MemFree(_ctx, _framePreloadCmdbuf);
-          _framePreloadCmdbuf = nullptr;
-      } else {
-        return CVI_RC_SUCCESS;
-      }
+  if (cmdbuf) {
+    (channel ? _channelGatherCmdbufs : _frameGatherCmdbufs)[num] = cmdbuf;
   }
-  return ret;
+  return cmdbuf;
 }
 
-// just copy vpss data to neuron and
-// keep w and frame dimensions's alignment.
-CVI_RC Neuron::preload(int32_t frame_idx, uint64_t src_paddr) {
-  uint32_t frame_size = align_up(_size / shape[0], vpss_w_align);
-  CVI_RC ret = CVI_RC_SUCCESS;
-  for (int i = 0; i < 3; ++i) {
-      if (!_framePreloadCmdbuf) {
-          cvk_tg_shape_t tg_shape = {1, 1, frame_size / vpss_w_align, (uint32_t)vpss_w_align};
-          _framePreloadCmdbuf     = runtimeJitTdmaStrideCopy(
-                  _ctx, _cvk, CVI_FMT_INT8, &tg_shape,
-                  nullptr, &tg_shape, nullptr);
-          if (!_framePreloadCmdbuf) {
-              continue;
-          }
+// submit once for every TDMA_GATHER_MAX_FRAMES channels or frames,
+// rather than once per channel or frame.
+CVI_RC Neuron::gather(bool channel, const uint64_t *src_paddrs, int32_t num) {
+  auto &cmdbufs = channel ? _channelGatherCmdbufs : _frameGatherCmdbufs;
+  for (int32_t i = 0; i < num; i += TDMA_GATHER_MAX_FRAMES) {
+    int frames = std::min(num - i, (int32_t)TDMA_GATHER_MAX_FRAMES);
+    CVI_RC ret = CVI_RC_FAILURE;
+    for (int retry = 0; retry < 3 && ret != CVI_RC_SUCCESS; ++retry) {
+      uint64_t offset = 0;
+      auto cmdbuf = jitGather(channel, frames, offset);
+      if (!cmdbuf) {
+        continue;
       }
-      ret = runtimeExecuteKernelFunction(
-          _ctx, _framePreloadCmdbuf, src_paddr,
-          _paddr + frame_idx * frame_size);
+      ret = runtimeExecuteGatherFunction(
+          _ctx, cmdbuf, src_paddrs + i, frames, _paddr + i * offset);
       if (ret != CVI_RC_SUCCESS) {
-          TPU_LOG_ERROR("preload fail!ret:%d", ret);
-          CVI_RT_MemFree(_ctx, _framePreloadCmdbuf);
-          _framePreloadCmdbuf = nullptr;
-      } else {
-        return CVI_RC_SUCCESS;
+        TPU_LOG_ERROR("preload %s fail!ret:%d\n", channel ? "channels" : "frames", ret);
+        runtimeReleaseTdmaStrideCopy(_ctx, cmdbuf, true);
+        cmdbufs.erase(frames);
       }
+    }
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+  }
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC Neuron::preloadChannels(const uint64_t *src_paddrs, int32_t channel_num) {
+  return gather(true, src_paddrs, channel_num);
+}
+
+CVI_RC Neuron::preloadFrames(const uint64_t *src_paddrs, int32_t frame_num) {
+  return gather(false, src_paddrs, frame_num);
+}
+
+void Neuron::warmup() {
+  // only inputs of image are fed by frames.
+  if (pixel_format == CVI_NN_PIXEL_TENSOR) {
+    return;
+  }
+  uint64_t offset;
+  int n = shape[0];
+  if (!aligned && n == 1) {
+    uint32_t c, h, w;
+    channelShape(c, h, w);
+    jitGather(true, c, offset);
+  }
+  // single aligned frame is bound in place, see CVI_NN_SetTensorWithAlignedFrames.
+  if (aligned && n == 1) {
+    return;
+  }
+  jitGather(false, std::min(n, TDMA_GATHER_MAX_FRAMES), offset);
+  if (n > TDMA_GATHER_MAX_FRAMES && n % TDMA_GATHER_MAX_FRAMES) {
+    jitGather(false, n % TDMA_GATHER_MAX_FRAMES, offset);
   }
-  return ret;
 }
 
 void Neuron::load(CVI_TENSOR &tensor) {
   // load data from system mem.
   if (tensor.mem_type == CVI_MEM_SYSTEM) {
     if (_vaddr) {
+      // only the valid prefix given by mem_size is transferred.
+      size_t len = (tensor.mem_size && tensor.mem_size < _size) ?
+                   tensor.mem_size : _size;
       if (_vaddr != tensor.sys_mem) {
-        memcpy(_vaddr, tensor.sys_mem, _size);
+        memcpy(_vaddr, tensor.sys_mem, len);
       }
-      TPU_ASSERT((int)CVI_RT_MemFlush(_ctx, _gmem) == 0, nullptr);
+      flush(len);
       _state = Neuron::TPU_MEM;
     } else {
       if (_cpu_mem != tensor.sys_mem) {
@@ -423,7 +443,7 @@ void Neuron::load(CVI_TENSOR &tensor) {
         tg_shape.h = shape[2];
         tg_shape.w = shape[3];
         _streamCopyCmdbuf =
-            runtimeJitTdmaStrideCopy(_ctx, _cvk, fmt, &tg_shape, nullptr, &tg_shape, nullptr);
+            runtimeAcquireTdmaStrideCopy(_ctx, _cvk, fmt, &tg_shape, nullptr, &tg_shape, nullptr);
       }
       runtimeExecuteKernelFunction(_ctx, _streamCopyCmdbuf, tensor.paddr, _paddr);
     }
@@ -437,7 +457,7 @@ void Neuron::store(CVI_TENSOR &tensor) {
       if (tensor.sys_mem != sys_mem())
         memcpy(tensor.sys_mem, sys_mem(), _size);
     } else {
-      TPU_ASSERT((int)CVI_RT_MemInvld(_ctx, _gmem) == 0,nullptr);
+      invalidate(_size);
       if (tensor.sys_mem != _vaddr)
         memcpy(tensor.sys_mem, _vaddr, _size);
     }
@@ -450,7 +470,7 @@ void Neuron::store(CVI_TENSOR &tensor) {
         tg_shape.h = shape[2];
         tg_shape.w = shape[3];
         _streamCopyCmdbuf =
-            runtimeJitTdmaStrideCopy(_ctx, _cvk, fmt, &tg_shape, nullptr, &tg_shape, nullptr);
+            runtimeAcquireTdmaStrideCopy(_ctx, _cvk, fmt, &tg_shape, nullptr, &tg_shape, nullptr);
       }
       runtimeExecuteKernelFunction(_ctx, _streamCopyCmdbuf, _paddr, tensor.paddr);
     }
@@ -462,24 +482,66 @@ void Neuron::toCpu() {
     if (_cpu_mem) {
       CVI_RT_MemCopyD2S(_ctx, _cpu_mem, _gmem);
     } else {
-      TPU_ASSERT((int)CVI_RT_MemInvld(_ctx, _gmem) == 0, nullptr);
+      invalidate(_size);
     }
     _state = Neuron::CPU_MEM;
   }
 }
 
-void Neuron::toTpu() {
-  if (_state != Neuron::TPU_MEM) {
-    if (_cpu_mem) {
+// Replay a step of transfer plan, the state has been
+// checked at load time.
+void Neuron::transfer(Transfer op) {
+  switch (op) {
+    case FLUSH:
+      flush(_size);
+      _state = Neuron::TPU_MEM;
+      break;
+    case COPY_S2D:
       CVI_RT_MemCopyS2D(_ctx, _gmem, _cpu_mem);
-      //TPU_LOG_DEBUG("load data from cpu_mem (%p) to device_mem (%p)\n",
-      //              (void *)_cpu_mem, (void *)_gmem);
-    } else {
-      CVI_RT_MemFlush(_ctx, _gmem);
-      CVI_RT_MemInvld(_ctx, _base_mem);
-      //TPU_LOG_DEBUG("flush device_mem (%p)\n", (void *)_vaddr);
-    }
-    _state = Neuron::TPU_MEM;
+      _state = Neuron::TPU_MEM;
+      break;
+    case INVALIDATE:
+      invalidate(_size);
+      _state = Neuron::CPU_MEM;
+      break;
+    case COPY_D2S:
+      CVI_RT_MemCopyD2S(_ctx, _cpu_mem, _gmem);
+      _state = Neuron::CPU_MEM;
+      break;
+    case FLUSH_DIRTY:
+      flushDirty();
+      break;
+  }
+}
+
+// Flush cpu outputs which are not consumed by tpu, otherwise
+// their dirty cache lines may be evicted after a later tpu routine
+// writes the same memory.
+void Neuron::flushDirty() {
+  if (_dirty) {
+    flush(_size);
+  }
+}
+
+// cache of bound buffer (no _gmem) is maintained by its owner.
+void Neuron::flush(size_t len) {
+  _dirty = false;
+  if (!_gmem) {
+    return;
+  }
+  TPU_ASSERT((int)CVI_RT_MemFlushEx(_ctx, _gmem, len) == 0, nullptr);
+  if (_cache_stats) {
+    _cache_stats->flushed += len;
+  }
+}
+
+void Neuron::invalidate(size_t len) {
+  if (!_gmem) {
+    return;
+  }
+  TPU_ASSERT((int)CVI_RT_MemInvldEx(_ctx, _gmem, len) == 0, nullptr);
+  if (_cache_stats) {
+    _cache_stats->invalidated += len;
   }
 }
 
@@ -491,8 +553,12 @@ CVI_RC Neuron::reserveIonMem(int64_t offset) {
   _baseAddrIndex = (offset >> 40 & 0x07);
   assert(_baseAddrIndex < 8 && _baseAddrIndex != 1);
   uint64_t shift = offset & 0x0FFFFFFFFFF;
+  _shift = shift;
   if (_baseAddrIndex < 3) { // shared mem
     _gmem = CVI_RT_MemPreAlloc(_baseMemArray[_baseAddrIndex], shift, _size);
+    if (_baseAddrIndex == 0) {
+      _shared_gmems[_baseMemArray[0]] = _gmem;
+    }
   } else {
     if (!_baseMemArray[_baseAddrIndex]) {
       assert(shift == 0);
@@ -513,6 +579,21 @@ CVI_RC Neuron::reserveIonMem(int64_t offset) {
   return CVI_RC_SUCCESS;
 }
 
+void Neuron::rebaseSharedMem(CVI_RT_MEM mem) {
+  assert(_baseAddrIndex == 0);
+  if (mem == _base_mem) {
+    return;
+  }
+  auto it = _shared_gmems.find(mem);
+  if (it == _shared_gmems.end()) {
+    it = _shared_gmems.emplace(mem, CVI_RT_MemPreAlloc(mem, _shift, _size)).first;
+  }
+  _gmem = it->second;
+  _base_mem = mem;
+  _vaddr = CVI_RT_MemGetVAddr(_gmem);
+  _paddr = CVI_RT_MemGetPAddr(_gmem);
+}
+
 CVI_RC Neuron::reserveSysMem() {
   /*
    * if the tensor has device_mem, we can use vaddr
@@ -520,7 +601,7 @@ CVI_RC Neuron::reserveSysMem() {
    * memory in such case. Otherwise, we need allocate
    * memory from heap.
    */
-  if (_gmem)
+  if (_gmem || _vaddr)
     return CVI_RC_SUCCESS;
 
   if (!_cpu_mem) {
@@ -546,6 +627,38 @@ void Neuron::updateBaseAddr(uint64_t paddr) {
   }
 }
 
+// Let tpu access the tensor in user's device buffer directly, the
+// io mem allocated by runtime is released.
+CVI_RC Neuron::bindDeviceMem(uint64_t paddr, uint8_t *vaddr) {
+  if (_baseAddrIndex < 3) {
+    TPU_LOG_ERROR("tensor %s is not in io mem, can't be bound\n", name.c_str());
+    return CVI_RC_UNSUPPORT;
+  }
+  if (_gmem) {
+    cviMemFree(_ctx, _gmem);
+    _gmem = nullptr;
+  }
+  _baseMemArray[_baseAddrIndex] = nullptr;
+  _baseAddrArray[_baseAddrIndex] = paddr;
+  _base_mem = nullptr;
+  _paddr = paddr;
+  _vaddr = vaddr;
+  return CVI_RC_SUCCESS;
+}
+
+void Neuron::swapDeviceMem(Neuron &other) {
+  assert(ownsIoMem() && other.ownsIoMem());
+  assert(_size == other._size);
+  std::swap(_gmem, other._gmem);
+  std::swap(_base_mem, other._base_mem);
+  std::swap(_vaddr, other._vaddr);
+  std::swap(_paddr, other._paddr);
+  _baseMemArray[_baseAddrIndex] = _gmem;
+  _baseAddrArray[_baseAddrIndex] = _paddr;
+  other._baseMemArray[other._baseAddrIndex] = other._gmem;
+  other._baseAddrArray[other._baseAddrIndex] = other._paddr;
+}
+
 void Neuron::updateBaseAddr(CVI_RT_MEM mem) {
   if (_baseAddrIndex < 3)
     return;
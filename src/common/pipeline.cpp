@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <string.h>
+#include <runtime/debug.h>
+#include <runtime/pipeline.hpp>
+
+namespace cvi {
+namespace runtime {
+
+Pipeline::Pipeline(Program *slots[SLOT_NUM]) {
+  for (int i = 0; i < SLOT_NUM; ++i) {
+    _slots[i] = slots[i];
+    _slot_busy[i] = false;
+  }
+  _worker = std::thread(&Pipeline::workFunc, this);
+}
+
+Pipeline::~Pipeline() {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done = true;
+    _cond_queue.notify_one();
+  }
+  if (_worker.joinable()) {
+    _worker.join();
+  }
+  for (auto task : _queue) {
+    free(task->staging);
+    delete task;
+  }
+  for (auto buf : _staging) {
+    free(buf);
+  }
+  for (auto &kv : _free_task_staging) {
+    free(kv.first);
+  }
+}
+
+uint8_t *Pipeline::allocStaging(size_t size) {
+  auto buf = (uint8_t *)aligned_alloc(32, (size + 63) / 64 * 64);
+  if (buf) {
+    _staging.push_back(buf);
+  }
+  return buf;
+}
+
+// Inputs are loaded into slot in head stage, which is finished
+// before submit() returns. But the memory of inputs which in
+// shared/private gmem of slot 0 may be reused by its tail stage,
+// so caller fills such inputs in staging buffers instead.
+CVI_TENSOR *Pipeline::exportInputs(int32_t &size) {
+  auto tensors = _slots[0]->exportInputs(size);
+  if (!tensors) {
+    return nullptr;
+  }
+  for (int i = 0; i < size; ++i) {
+    if (_slots[0]->in_tensors[i]->baseAddrIndex() >= 3) {
+      continue;
+    }
+    auto buf = allocStaging(tensors[i].mem_size);
+    if (!buf) {
+      TPU_LOG_ERROR("failed to alloc staging buffer for input:%s\n", tensors[i].name);
+      delete[] tensors;
+      size = 0;
+      return nullptr;
+    }
+    tensors[i].sys_mem = buf;
+    tensors[i].paddr = 0;
+  }
+  return tensors;
+}
+
+// Outputs of slot 0 may be rewritten by the request after next one
+// before caller consumes them, so they are always stored to staging
+// buffers. Tail stage stores to buffers of each task, see stageOutputs().
+CVI_TENSOR *Pipeline::exportOutputs(int32_t &size) {
+  auto tensors = _slots[0]->exportOutputs(size);
+  if (!tensors) {
+    return nullptr;
+  }
+  for (int i = 0; i < size; ++i) {
+    auto buf = allocStaging(tensors[i].mem_size);
+    if (!buf) {
+      TPU_LOG_ERROR("failed to alloc staging buffer for output:%s\n", tensors[i].name);
+      delete[] tensors;
+      size = 0;
+      return nullptr;
+    }
+    tensors[i].sys_mem = buf;
+    tensors[i].paddr = 0;
+  }
+  return tensors;
+}
+
+// Several requests may be in flight with the same outputs, so each task
+// has its own buffers for outputs in system memory, which are copied to
+// caller's outputs in submission order as tasks are waited.
+bool Pipeline::stageOutputs(Task *task) {
+  size_t total = 0;
+  for (int i = 0; i < task->output_num; ++i) {
+    total += (task->outputs[i].mem_size + 63) / 64 * 64;
+  }
+  task->staging = nullptr;
+  task->staging_size = 0;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto it = _free_task_staging.begin(); it != _free_task_staging.end(); ++it) {
+      if (it->second >= total) {
+        task->staging = it->first;
+        task->staging_size = it->second;
+        _free_task_staging.erase(it);
+        break;
+      }
+    }
+  }
+  if (!task->staging && total) {
+    task->staging = (uint8_t *)aligned_alloc(64, total);
+    if (!task->staging) {
+      TPU_LOG_ERROR("failed to alloc staging buffer for outputs\n");
+      return false;
+    }
+    task->staging_size = total;
+  }
+  task->staged.assign(task->outputs, task->outputs + task->output_num);
+  size_t offset = 0;
+  for (auto &t : task->staged) {
+    if (t.mem_type != CVI_MEM_SYSTEM) {
+      continue;
+    }
+    t.sys_mem = task->staging + offset;
+    offset += (t.mem_size + 63) / 64 * 64;
+  }
+  return true;
+}
+
+// Copy staged outputs to caller's, and recycle the staging buffer.
+CVI_RC Pipeline::finishTask(Task *task) {
+  CVI_RC ret = task->ret;
+  if (ret == CVI_RC_SUCCESS) {
+    for (int i = 0; i < task->output_num; ++i) {
+      auto &t = task->staged[i];
+      if (t.mem_type == CVI_MEM_SYSTEM && t.sys_mem != task->outputs[i].sys_mem) {
+        memcpy(task->outputs[i].sys_mem, t.sys_mem, t.mem_size);
+      }
+    }
+  }
+  if (task->staging) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _free_task_staging.emplace_back(task->staging, task->staging_size);
+  }
+  delete task;
+  return ret;
+}
+
+void *Pipeline::submit(CVI_TENSOR *inputs, int input_num,
+                       CVI_TENSOR *outputs, int output_num,
+                       CVI_NN_FORWARD_CALLBACK callback,
+                       void *model, void *user_data, int event_fd) {
+  // head stages are serialized, they share the tpu anyway.
+  std::unique_lock<std::mutex> submit_lock(_submit_mutex);
+  int slot = _next_slot;
+  _next_slot = (_next_slot + 1) % SLOT_NUM;
+  {
+    // wait for tail stage of previous request on this slot.
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_slot_busy[slot]) {
+      _cond_feedback.wait(lock);
+    }
+    _slot_busy[slot] = true;
+  }
+
+  auto task = new Task;
+  task->slot = slot;
+  task->outputs = outputs;
+  task->output_num = output_num;
+  task->done = false;
+  task->ret = CVI_RC_UNINIT;
+  task->callback = callback;
+  task->model = model;
+  task->user_data = user_data;
+  task->event_fd = event_fd;
+  task->head_ok = stageOutputs(task) &&
+                  _slots[slot]->forwardHead(inputs, input_num);
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _queue.push_back(task);
+  _cond_queue.notify_one();
+  return task;
+}
+
+CVI_RC Pipeline::wait(void *task) {
+  auto myTask = (Task *)task;
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!myTask->done) {
+    _cond_feedback.wait(lock);
+  }
+  lock.unlock();
+  return finishTask(myTask);
+}
+
+CVI_RC Pipeline::poll(void *task) {
+  auto myTask = (Task *)task;
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (!myTask->done) {
+    return CVI_RC_AGAIN;
+  }
+  lock.unlock();
+  return finishTask(myTask);
+}
+
+void Pipeline::workFunc() {
+  while (true) {
+    Task *task = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (_queue.empty() && !_done) {
+        _cond_queue.wait(lock);
+      }
+      if (_queue.empty()) {
+        return;
+      }
+      task = _queue.front();
+      _queue.pop_front();
+    }
+
+    bool ok = task->head_ok &&
+              _slots[task->slot]->forwardTail(task->staged.data(), task->output_num);
+
+    CVI_RC ret = ok ? CVI_RC_SUCCESS : CVI_RC_FAILURE;
+    auto callback = task->callback;
+    int slot = task->slot;
+    int event_fd = task->event_fd;
+    if (callback) {
+      auto model = task->model;
+      auto user_data = task->user_data;
+      task->ret = ret;
+      finishTask(task);
+      callback(model, ret, user_data);
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _slot_busy[slot] = false;
+      if (!callback) {
+        task->ret = ret;
+        task->done = true;
+      }
+      _cond_feedback.notify_all();
+    }
+    if (event_fd >= 0) {
+      signalEventFd(event_fd);
+    }
+  }
+}
+
+} // namespace runtime
+} // namespace cvi
@@ -8,6 +8,7 @@
 #include <runtime/program.hpp>
 #include <runtime/debug.h>
 #include <runtime/shared_mem.hpp>
+#include <runtime/load_profile.hpp>
 #include <cvibuilder/parameter_generated.h>
 #include "cviruntime.h"
 #include "alloc.h"
@@ -48,12 +49,18 @@ Program::~Program() {
   if (shared_mem) {
     deallocateSharedMemory(_ctx, shared_mem);
   }
-  if (private_mem) {
+  if (private_mem && _private_mem_owned) {
     cviMemFree(_ctx, private_mem);
   }
   if (_cvk) {
     CVI_RT_UnRegisterKernel(_cvk);
   }
+  if (_cpu_arena) {
+    free(_cpu_arena);
+  }
+  for (auto buf : _staging_bufs) {
+    free(buf);
+  }
 }
 
 void Program::setOptions(bool export_all_tensors, bool skip_preprocess) {
@@ -66,7 +73,9 @@ CVI_RC Program::createNeuronSpace(const cvi::model::Program *fb_program) {
   // neuron memory, the private gmem is same as shared gmem.
   if (fb_program->neuron_size()) {
     auto size = fb_program->neuron_size();
-    private_mem = cviMemAlloc(_ctx, size, CVI_ALLOC_PROGRAM, _model_name.c_str());
+    if (!private_mem) {
+      private_mem = cviMemAlloc(_ctx, size, CVI_ALLOC_PROGRAM, _model_name.c_str());
+    }
     if (!private_mem) {
       TPU_LOG_ERROR("failed to alloc private gmem: %u\n", size);
       return CVI_RC_NOMEM;
@@ -91,7 +100,9 @@ CVI_RC Program::createNeuronSpace(const cvi::model::Program *fb_program) {
 
   size = fb_program->private_gmem();
   if (size) {
-    private_mem = cviMemAlloc(_ctx, size, CVI_ALLOC_PROGRAM, _model_name.c_str());
+    if (!private_mem) {
+      private_mem = cviMemAlloc(_ctx, size, CVI_ALLOC_PROGRAM, _model_name.c_str());
+    }
     if (!private_mem) {
       TPU_LOG_ERROR("failed to alloc private gmem: %u\n", size);
       return CVI_RC_NOMEM;
@@ -111,6 +122,10 @@ CVI_RC Program::createNeuronMap(const cvi::model::Program *fb_program) {
     if (tensor->reserveIonMem(t->offset()) != CVI_RC_SUCCESS) {
       return CVI_RC_NOMEM;
     }
+    tensor->setCacheStats(&cache_stats);
+    if (shared_mem && tensor->baseAddrIndex() == 0) {
+      _shared_neurons.push_back(tensor);
+    }
     neuron_map[t->name()->str()] = tensor;
   }
 
@@ -143,6 +158,9 @@ CVI_RC Program::createRoutines(const cvi::model::Program *fb_program) {
       return CVI_RC_DATA_ERR;
     }
     _routines.push_back(rt);
+    if (rt->tpu) {
+      _head_routine_num = _routines.size();
+    }
   }
   return CVI_RC_SUCCESS;
 }
@@ -155,25 +173,194 @@ CVI_RC Program::load(const cvi::model::Program *fb_program) {
     return ret;
   }
 
+  LoadTimer timer;
   ret = this->createNeuronMap(fb_program);
   if (ret != CVI_RC_SUCCESS) {
     return ret;
   }
+  neuron_map_time_us = timer.elapsed_us();
 
   ret = this->createRoutines(fb_program);
   if (ret != CVI_RC_SUCCESS) {
     return ret;
   }
 
+  ret = this->createCpuArena();
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+
   for (auto &rt : _routines) {
     ret = rt->prepare();
     if (ret != CVI_RC_SUCCESS) {
       return ret;
     }
   }
+  planTransfers();
+  return CVI_RC_SUCCESS;
+}
+
+// Tensors of cpu routines without device memory share one arena.
+// Each tensor lives from its first to its last use in routine order,
+// and gets the lowest offset not used by tensors whose lifetime
+// overlaps with it.
+CVI_RC Program::createCpuArena() {
+  struct Interval {
+    std::shared_ptr<Neuron> neuron;
+    int start;
+    int end;
+    size_t size;
+    size_t offset;
+  };
+  std::map<Neuron *, Interval> intervals;
+  int last = (int)_routines.size() + 1;
+  int idx = 0;
+  for (auto &r : _routines) {
+    ++idx;
+    if (r->tpu) {
+      continue;
+    }
+    for (auto list : {&r->inputs, &r->outputs}) {
+      for (auto &neuron : *list) {
+        if (neuron->type != Neuron::ACTIVATION || neuron->hasDeviceMem()) {
+          continue;
+        }
+        auto it = intervals.find(neuron.get());
+        if (it == intervals.end()) {
+          size_t size = (neuron->size() + 63) / 64 * 64;
+          intervals[neuron.get()] = {neuron, idx, idx, size, 0};
+        } else {
+          it->second.start = std::min(it->second.start, idx);
+          it->second.end = std::max(it->second.end, idx);
+        }
+      }
+    }
+  }
+  if (intervals.empty()) {
+    return CVI_RC_SUCCESS;
+  }
+  // exported tensors are accessed by caller between inferences,
+  // so they never share memory with others.
+  for (auto &kv : intervals) {
+    auto &iv = kv.second;
+    if (_export_all_tensors ||
+        std::find(in_tensors.begin(), in_tensors.end(), iv.neuron) != in_tensors.end() ||
+        std::find(out_tensors.begin(), out_tensors.end(), iv.neuron) != out_tensors.end()) {
+      iv.start = 0;
+      iv.end = last;
+    }
+  }
+
+  std::vector<Interval *> order;
+  for (auto &kv : intervals) {
+    order.push_back(&kv.second);
+  }
+  std::sort(order.begin(), order.end(), [](Interval *a, Interval *b) {
+    return a->size > b->size;
+  });
+  std::vector<Interval *> placed;
+  for (auto iv : order) {
+    // placed tensors alive at the same time, sorted by offset.
+    std::vector<Interval *> alive;
+    for (auto p : placed) {
+      if (p->start <= iv->end && iv->start <= p->end) {
+        alive.push_back(p);
+      }
+    }
+    std::sort(alive.begin(), alive.end(), [](Interval *a, Interval *b) {
+      return a->offset < b->offset;
+    });
+    size_t offset = 0;
+    for (auto p : alive) {
+      if (offset + iv->size <= p->offset) {
+        break;
+      }
+      offset = std::max(offset, p->offset + p->size);
+    }
+    iv->offset = offset;
+    placed.push_back(iv);
+    cpu_arena_size = std::max(cpu_arena_size, offset + iv->size);
+    cpu_tensors_size += iv->size;
+  }
+
+  _cpu_arena = (uint8_t *)aligned_alloc(32, cpu_arena_size);
+  if (!_cpu_arena) {
+    TPU_LOG_ERROR("failed to alloc cpu arena, size:%zu\n", cpu_arena_size);
+    return CVI_RC_NOMEM;
+  }
+  for (auto iv : placed) {
+    iv->neuron->setSysMem(_cpu_arena + iv->offset);
+  }
+  TPU_LOG_INFO("cpu arena of %s: %zu bytes, %zu bytes without sharing\n",
+               _model_name.c_str(), cpu_arena_size, cpu_tensors_size);
   return CVI_RC_SUCCESS;
 }
 
+// Decide once which transfers each routine needs on its inputs, by
+// following where every tensor lives along routines: outputs stay in
+// memory of the side producing them, inputs with device memory are
+// on tpu side after being loaded, weights are on cpu side after
+// cpu routines are initialized.
+void Program::planTransfers() {
+  std::map<Neuron *, Neuron::NeuronState> states;
+  for (auto &kv : neuron_map) {
+    auto &neuron = kv.second;
+    states[neuron.get()] = neuron->hasDeviceMem() ? Neuron::TPU_MEM : Neuron::CPU_MEM;
+  }
+  for (auto &kv : weight_map) {
+    states[kv.second.get()] = Neuron::CPU_MEM;
+  }
+  for (auto &r : _routines) {
+    for (auto &neuron : r->outputs) {
+      states[neuron.get()] = r->tpu ? Neuron::TPU_MEM : Neuron::CPU_MEM;
+    }
+  }
+
+  std::shared_ptr<Routine> first_tpu;
+  for (auto &r : _routines) {
+    r->plan.clear();
+    for (auto &neuron : r->inputs) {
+      auto &state = states[neuron.get()];
+      if (r->tpu && state == Neuron::CPU_MEM) {
+        r->plan.emplace_back(neuron, neuron->tpuTransfer());
+        state = Neuron::TPU_MEM;
+      } else if (!r->tpu && state == Neuron::TPU_MEM) {
+        r->plan.emplace_back(neuron, neuron->cpuTransfer());
+        state = Neuron::CPU_MEM;
+      }
+    }
+    if (r->tpu && !first_tpu) {
+      first_tpu = r;
+    }
+  }
+
+  // outputs of cpu routines never passed to tpu are left dirty in cache,
+  // flush them before the next tpu routine runs, in this inference or
+  // the next one, otherwise their cache lines may be evicted after tpu
+  // writes the same memory.
+  if (!first_tpu) {
+    return;
+  }
+  for (auto it = _routines.begin(); it != _routines.end(); ++it) {
+    auto &r = *it;
+    if (r->tpu) {
+      continue;
+    }
+    auto next_tpu = first_tpu;
+    for (auto next = std::next(it); next != _routines.end(); ++next) {
+      if ((*next)->tpu) {
+        next_tpu = *next;
+        break;
+      }
+    }
+    for (auto &neuron : r->outputs) {
+      if (states[neuron.get()] == Neuron::CPU_MEM && neuron->hasDeviceMem()) {
+        next_tpu->plan.emplace_back(neuron, Neuron::FLUSH_DIRTY);
+      }
+    }
+  }
+}
+
 static void exportTensorInfo(void *program, const std::shared_ptr<Neuron> &neuron,
                              CVI_TENSOR *tensor) {
   tensor->name = const_cast<char *>(neuron->name.c_str());
@@ -201,6 +388,135 @@ static void exportTensorInfo(void *program, const std::shared_ptr<Neuron> &neuro
   tensor->owner = program;
 }
 
+static std::shared_ptr<Neuron> findNeuron(const tensor_list_t &list,
+                                          const std::string &name) {
+  for (auto &neuron : list) {
+    if (neuron->name == name) {
+      return neuron;
+    }
+  }
+  return nullptr;
+}
+
+// neuron is the only one in its io mem, whose base address can be moved.
+bool Program::ownsIoIndex(const std::shared_ptr<Neuron> &neuron) {
+  if (!neuron->ownsIoMem()) {
+    return false;
+  }
+  for (auto &kv : neuron_map) {
+    if (kv.second != neuron &&
+        kv.second->baseAddrIndex() == neuron->baseAddrIndex()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+CVI_RC Program::bindOutput(const std::string &name, uint64_t paddr, uint8_t *vaddr) {
+  for (auto &neuron : out_tensors) {
+    if (neuron->name != name) {
+      continue;
+    }
+    // cpu routines read it by vaddr, whose cache can't be
+    // maintained by runtime any more.
+    for (auto &r : _routines) {
+      if (!r->tpu && std::find(r->inputs.begin(), r->inputs.end(), neuron) != r->inputs.end()) {
+        TPU_LOG_ERROR("output %s is consumed by cpu routine, can't be bound\n",
+                      name.c_str());
+        return CVI_RC_UNSUPPORT;
+      }
+    }
+    if (!ownsIoIndex(neuron)) {
+      TPU_LOG_ERROR("output %s has no io mem of its own\n", name.c_str());
+      return CVI_RC_UNSUPPORT;
+    }
+    return neuron->bindDeviceMem(paddr, vaddr);
+  }
+  TPU_LOG_ERROR("output %s not found\n", name.c_str());
+  return CVI_RC_INVALID_ARG;
+}
+
+CVI_RC Program::bindInput(const std::string &name, uint64_t paddr, uint8_t *vaddr) {
+  auto neuron = findNeuron(in_tensors, name);
+  if (!neuron) {
+    TPU_LOG_ERROR("input %s not found\n", name.c_str());
+    return CVI_RC_INVALID_ARG;
+  }
+  // same as bindOutput, cache of the buffer isn't maintained by us.
+  for (auto &r : _routines) {
+    if (!r->tpu && std::find(r->inputs.begin(), r->inputs.end(), neuron) != r->inputs.end()) {
+      TPU_LOG_ERROR("input %s is consumed by cpu routine, can't be bound\n",
+                    name.c_str());
+      return CVI_RC_UNSUPPORT;
+    }
+  }
+  if (!ownsIoIndex(neuron)) {
+    TPU_LOG_ERROR("input %s has no io mem of its own\n", name.c_str());
+    return CVI_RC_UNSUPPORT;
+  }
+  return neuron->bindDeviceMem(paddr, vaddr);
+}
+
+CVI_RC Program::bindState(const std::string &output_name,
+                          const std::string &input_name) {
+  auto output = findNeuron(out_tensors, output_name);
+  auto input = findNeuron(in_tensors, input_name);
+  if (!output || !input) {
+    TPU_LOG_ERROR("state tensor %s -> %s not found\n",
+                  output_name.c_str(), input_name.c_str());
+    return CVI_RC_INVALID_ARG;
+  }
+  if (_export_all_tensors || output->size() != input->size()) {
+    TPU_LOG_ERROR("state tensor %s -> %s mismatch\n",
+                  output_name.c_str(), input_name.c_str());
+    return CVI_RC_INVALID_ARG;
+  }
+  for (auto &neuron : {output, input}) {
+    if (!ownsIoIndex(neuron)) {
+      TPU_LOG_ERROR("tensor %s has no io mem of its own\n", neuron->name.c_str());
+      return CVI_RC_UNSUPPORT;
+    }
+    for (auto &st : _states) {
+      if (st.output == neuron || st.input == neuron) {
+        TPU_LOG_ERROR("tensor %s is already a state\n", neuron->name.c_str());
+        return CVI_RC_INVALID_ARG;
+      }
+    }
+  }
+  // state must be written by tpu, so that it never needs cache maintenance.
+  if (writtenByCpu(output)) {
+    TPU_LOG_ERROR("state tensor %s is written by cpu\n", output_name.c_str());
+    return CVI_RC_UNSUPPORT;
+  }
+  _states.push_back({output, input, false});
+  return CVI_RC_SUCCESS;
+}
+
+bool Program::writtenByCpu(const std::shared_ptr<Neuron> &neuron) {
+  for (auto &r : _routines) {
+    if (!r->tpu && std::find(r->outputs.begin(), r->outputs.end(), neuron) != r->outputs.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Program::resetStates() {
+  for (auto &st : _states) {
+    st.primed = false;
+  }
+}
+
+// Swap io mem of outputs and inputs bound as states, the input of
+// next forward is then the output of this one, without copying.
+void Program::updateStates() {
+  for (auto &st : _states) {
+    st.input->swapDeviceMem(*st.output);
+    st.input->setState(Neuron::TPU_MEM);
+    st.primed = true;
+  }
+}
+
 CVI_TENSOR *Program::exportInputs(int32_t &size) {
   size = this->in_tensors.size();
   auto *tensors = new CVI_TENSOR[size];
@@ -209,10 +525,32 @@ CVI_TENSOR *Program::exportInputs(int32_t &size) {
   }
   for (int i = 0; i < size; i++) {
     exportTensorInfo(this, this->in_tensors[i], tensors + i);
+    stageSharedTensor(this->in_tensors[i], tensors + i);
   }
   return tensors;
 }
 
+// With shared memory pool, a program may run on any slot, and the
+// slot it was loaded on may be used by others between inferences.
+// Likewise private gmem given by setPrivateMem() is rewritten by other
+// programs. So exported tensors in such memory are given host buffers,
+// which are copied in and out by load()/store() of forward.
+void Program::stageSharedTensor(const std::shared_ptr<Neuron> &neuron,
+                                CVI_TENSOR *tensor) {
+  auto idx = neuron->baseAddrIndex();
+  bool in_pool = inSharedMemPool(neuron);
+  bool in_private = !_private_mem_owned && private_mem &&
+                    (idx == 2 || (idx == 0 && !shared_mem));
+  if (!in_pool && !in_private) {
+    return;
+  }
+  auto buf = (uint8_t *)aligned_alloc(32, (neuron->size() + 63) / 64 * 64);
+  TPU_ASSERT(buf, "failed to alloc staging buffer");
+  _staging_bufs.push_back(buf);
+  tensor->sys_mem = buf;
+  tensor->paddr = 0;
+}
+
 CVI_TENSOR *Program::exportOutputs(int32_t &size) {
   int i = 0;
   CVI_TENSOR *tensors = nullptr;
@@ -225,6 +563,7 @@ CVI_TENSOR *Program::exportOutputs(int32_t &size) {
     }
     for (; i < size; i++) {
       exportTensorInfo(this, out_tensors[i], tensors + i);
+      stageSharedTensor(out_tensors[i], tensors + i);
     }
   } else {
     for (auto &kv : neuron_map) {
@@ -244,6 +583,7 @@ CVI_TENSOR *Program::exportOutputs(int32_t &size) {
         continue;
 
       exportTensorInfo(this, tensor, tensors + i);
+      stageSharedTensor(tensor, tensors + i);
       ++i;
     }
     size = i;
@@ -266,11 +606,8 @@ bool Program::forward(CVI_TENSOR *inputs, int input_num,
   gettimeofday(&t0, NULL);
 #endif
 
-  TPU_ASSERT(input_num == (int)in_tensors.size(), nullptr);
-  for (int i = 0; i < (int)in_tensors.size(); i++) {
-    auto &tensor = this->in_tensors[i];
-    tensor->load(inputs[i]);
-  }
+  auto slot = acquireSharedMem();
+  loadInputs(inputs, input_num);
 
 #ifdef MEASURE_TIME
   gettimeofday(&t1, NULL);
@@ -280,6 +617,7 @@ bool Program::forward(CVI_TENSOR *inputs, int input_num,
 #endif
 
   if (!this->run()) {
+    releaseSharedMem(slot);
     return false;
   }
 
@@ -290,11 +628,98 @@ bool Program::forward(CVI_TENSOR *inputs, int input_num,
   t0 = t1;
 #endif
 
+  storeOutputs(outputs, output_num);
+  releaseSharedMem(slot);
+
+#ifdef MEASURE_TIME
+  gettimeofday(&t1, NULL);
+  elapsed = (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec;
+  printf("  PERF: [store ] %ld us\n", elapsed);
+#endif
+
+  return true;
+}
+
+bool Program::inSharedMemPool(const std::shared_ptr<Neuron> &neuron) {
+  return shared_mem && neuron->baseAddrIndex() == 0 && sharedMemSlotNum() > 0;
+}
+
+// Hold a slot of shared memory pool for one inference, and move
+// neurons of shared memory onto it. Returns nullptr if the pool
+// is disabled, then shared memory is used without arbitration.
+CVI_RT_MEM Program::acquireSharedMem() {
+  if (!shared_mem || sharedMemSlotNum() == 0) {
+    return nullptr;
+  }
+  auto mem = acquireSharedMemSlot(_ctx, _max_shared_mem_size);
+  TPU_ASSERT(mem, "failed to acquire shared memory slot");
+  if (mem != baseMemArray[0]) {
+    baseMemArray[0] = mem;
+    baseAddrArray[0] = CVI_RT_MemGetPAddr(mem);
+    for (auto &neuron : _shared_neurons) {
+      neuron->rebaseSharedMem(mem);
+    }
+  }
+  return mem;
+}
+
+void Program::releaseSharedMem(CVI_RT_MEM mem) {
+  if (mem) {
+    releaseSharedMemSlot(mem);
+  }
+}
+
+void *Program::forwardAsync(CVI_TENSOR *inputs, int input_num, CVI_TENSOR *outputs,
+                            int output_num, CVI_NN_FORWARD_CALLBACK callback,
+                            void *model, void *user_data, int event_fd) {
+  _pool->startPool();
+  auto task = _pool->acquireTask();
+  task->reset((void *)this, inputs, input_num, outputs, output_num,
+              callback, model, user_data, event_fd);
+  _pool->addTask(task);
+  return task;
+}
+
+CVI_RC Program::forwardWait(void *task) {
+  return _pool->waitTask((Task *)task);
+}
+
+CVI_RC Program::forwardPoll(void *task) {
+  return _pool->pollTask((Task *)task);
+}
+
+void Program::loadInputs(CVI_TENSOR *inputs, int input_num) {
+  cache_stats = CacheStats();
+  TPU_ASSERT(input_num == (int)in_tensors.size(), nullptr);
+  for (int i = 0; i < (int)in_tensors.size(); i++) {
+    auto &tensor = this->in_tensors[i];
+    bool primed = false;
+    for (auto &st : _states) {
+      if (st.input == tensor) {
+        primed = st.primed;
+        break;
+      }
+    }
+    if (!primed) {
+      tensor->load(inputs[i]);
+    }
+  }
+}
+
+void Program::storeOutputs(CVI_TENSOR *outputs, int output_num) {
   if (!_export_all_tensors) {
     TPU_ASSERT(output_num == (int)out_tensors.size(), nullptr);
     for (int i = 0; i < (int)out_tensors.size(); i++) {
-      out_tensors[i]->store(outputs[i]);
+      bool is_state = false;
+      for (auto &st : _states) {
+        is_state |= (st.output == out_tensors[i]);
+      }
+      // states stay in device memory
+      if (!is_state) {
+        out_tensors[i]->store(outputs[i]);
+      }
     }
+    updateStates();
   } else {
     int i = 0;
     for (auto &kv : neuron_map) {
@@ -307,26 +732,75 @@ bool Program::forward(CVI_TENSOR *inputs, int input_num,
     }
     TPU_ASSERT(output_num == i, nullptr);
   }
+}
 
-#ifdef MEASURE_TIME
-  gettimeofday(&t1, NULL);
-  elapsed = (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec;
-  printf("  PERF: [store ] %ld us\n", elapsed);
-#endif
+bool Program::forwardHead(CVI_TENSOR *inputs, int input_num) {
+  // tail doesn't touch shared memory, see pipelineable().
+  auto slot = acquireSharedMem();
+  loadInputs(inputs, input_num);
+  // reset all routines for new inference.
+  for (auto &r : _routines) {
+    r->reset();
+  }
+  runRoutines(0, _head_routine_num);
+  releaseSharedMem(slot);
+  return true;
+}
 
+bool Program::forwardTail(CVI_TENSOR *outputs, int output_num) {
+  runRoutines(_head_routine_num, _routines.size());
+  storeOutputs(outputs, output_num);
   return true;
 }
 
-void *Program::forwardAsync(CVI_TENSOR *inputs, int input_num, CVI_TENSOR *outputs,
-                            int output_num) {
-  _pool->startPool();
-  return new Task(_pool, (void *)this, inputs, input_num, outputs, output_num);
+// The tail stage of one request runs concurrently with the head
+// stage of next request on another Program instance. It's only
+// safe if the tail doesn't touch memory which is shared between
+// instances (shared gmem) or rewritten by caller before next
+// submission (the input tensors).
+bool Program::pipelineable() {
+  if (_export_all_tensors) {
+    return false;
+  }
+  // outputs are stored in tail stage too.
+  for (auto &neuron : out_tensors) {
+    if (shared_mem && neuron->baseAddrIndex() == 0) {
+      return false;
+    }
+  }
+  size_t idx = 0;
+  for (auto &r : _routines) {
+    if (idx++ < _head_routine_num) {
+      continue;
+    }
+    for (auto &neuron : r->inputs) {
+      if (neuron->type == Neuron::WEIGHT) {
+        continue;
+      }
+      if (shared_mem && neuron->baseAddrIndex() == 0) {
+        return false;
+      }
+      if (std::find(in_tensors.begin(), in_tensors.end(), neuron) != in_tensors.end()) {
+        return false;
+      }
+    }
+    for (auto &neuron : r->outputs) {
+      if (shared_mem && neuron->baseAddrIndex() == 0) {
+        return false;
+      }
+    }
+  }
+  return true;
 }
 
-CVI_RC Program::forwardWait(void *task) {
-  auto *myTask = (Task *)task;
-  _pool->waitTask(myTask);
-  return myTask->retCode;
+void Program::runRoutines(size_t begin, size_t end) {
+  size_t idx = 0;
+  for (auto &r : _routines) {
+    if (idx >= begin && idx < end) {
+      r->run();
+    }
+    ++idx;
+  }
 }
 
 bool Program::run() {
@@ -334,9 +808,7 @@ bool Program::run() {
   for (auto &r : _routines) {
     r->reset();
   }
-  for (auto &r : _routines) {
-    r->run();
-  }
+  runRoutines(0, _routines.size());
   return true;
 }
 
@@ -363,6 +835,13 @@ int TpuRoutine::init_dmabuf (Program *program, const std::string &name) {
 #else
   TPU_LOG_WARNING("Tpu pmu is not supported! please recompile with ENABLE_PMU\n");
 #endif
+  // dmabuf is shared by all programs of the model, submit with a header
+  // of our own so that concurrent instances don't race on it.
+  if (!this->enable_pmu && !this->encrypted) {
+    if (CVI_RT_DupDmabufHeader(_ctx, buf_mem, &header_mem) != CVI_RC_SUCCESS) {
+      header_mem = nullptr;
+    }
+  }
   return CVI_RC_SUCCESS;
 }
 
@@ -399,9 +878,7 @@ CVI_RC TpuRoutine::run() {
   gettimeofday(&t0, NULL);
 #endif
 
-  for (auto &neuron : inputs) {
-    neuron->toTpu();
-  }
+  transferInputs();
 
 #ifdef MEASURE_TIME
   gettimeofday(&t1, NULL);
@@ -415,7 +892,7 @@ CVI_RC TpuRoutine::run() {
   if (this->encrypted) {
     ret = CVI_RT_RunCmdbufTee(_ctx, buf_mem, baseArray);
   } else {
-    ret = CVI_RT_RunCmdbufEx(_ctx, buf_mem, baseArray);
+    ret = CVI_RT_RunCmdbufEx(_ctx, header_mem ? header_mem : buf_mem, baseArray);
   }
 
   if (ret != 0) {
@@ -549,7 +1026,9 @@ bool CpuRoutine::initialize(const cvi::model::Routine *routine) {
       fetchQscaleFromDequant(param);
     }
   }
+  LoadTimer timer;
   _func->setup(inputs, outputs, param);
+  _program->cpu_setup_time_us += timer.elapsed_us();
   return true;
 }
 
@@ -577,9 +1056,7 @@ CVI_RC CpuRoutine::run() {
   gettimeofday(&t0, NULL);
 #endif
 
-  for (auto &neuron : inputs) {
-    neuron->toCpu();
-  }
+  transferInputs();
 
 #ifdef MEASURE_TIME
   gettimeofday(&t1, NULL);
@@ -589,6 +1066,9 @@ CVI_RC CpuRoutine::run() {
 #endif
 
   _func->run();
+  for (auto &neuron : outputs) {
+    neuron->markDirty();
+  }
 
 #ifdef MEASURE_TIME
   gettimeofday(&t1, NULL);
@@ -1,15 +1,24 @@
 #include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <dlfcn.h>
 #include <iostream>
 #include <sstream>
 #include <stdlib.h>
 #include <mutex>
+#include <functional>
+#include <thread>
+#include <atomic>
 #include <string.h>
+#include <errno.h>
 #include <runtime/debug.h>
 #include <runtime/model.hpp>
 #include <runtime/stream.hpp>
 #include <runtime/shared_mem.hpp>
+#include <runtime/model_cache.hpp>
+#include <runtime/pipeline.hpp>
+#include <runtime/batcher.hpp>
+#include <runtime/graph.hpp>
 #include "cviruntime.h"
 #include "cviruntime_context.h"
 #include "alloc.h"
@@ -19,7 +28,7 @@ using namespace cvi::runtime;
 static CVI_RT_HANDLE g_ctx = nullptr;
 static int g_ctx_ref_count = 0;
 static std::mutex g_ctx_mutex;
-static int g_model_count = 0;
+static std::atomic<int> g_model_count(0);
 
 struct ModelInstance {
   ModelInstance(CviModel *model) :
@@ -28,14 +37,33 @@ struct ModelInstance {
   }
 
   ~ModelInstance() {
+    if (!programs.empty()) {
+      for (auto &t : program_tensors) {
+        delete[] t.inputs;
+        delete[] t.outputs;
+      }
+      model->unloadAllPrograms(programs, private_mem);
+      program = nullptr;
+      inputs = nullptr;
+      outputs = nullptr;
+    }
     if (inputs) {
       delete[] inputs;
     }
     if (outputs) {
       delete[] outputs;
     }
+    if (pipeline) {
+      delete pipeline;
+    }
+    if (pipeline_program) {
+      model->unloadProgram(pipeline_program);
+    }
     if (program) {
-      delete program;
+      model->unloadProgram(program);
+    }
+    if (event_fd >= 0) {
+      close(event_fd);
     }
     model->release();
   }
@@ -50,6 +78,34 @@ struct ModelInstance {
   int32_t program_num = 1;
   bool output_all_tensors_for_debug = false;
   bool skip_preprocess = false;
+  bool enable_pipeline = false;
+  // second instance of program for pipelined mode
+  cvi::runtime::Program *pipeline_program = nullptr;
+  cvi::runtime::Pipeline *pipeline = nullptr;
+  // eventfd signalled by async tasks, created on demand
+  // created on demand while other threads may be submitting
+  std::atomic<int> event_fd{-1};
+  // all programs loaded with one private gmem, see OPTION_MULTI_PROGRAM
+  bool multi_program = false;
+  struct ProgramTensors {
+    CVI_TENSOR *inputs = nullptr;
+    CVI_TENSOR *outputs = nullptr;
+    int32_t input_num = 0;
+    int32_t output_num = 0;
+  };
+  std::vector<cvi::runtime::Program *> programs;
+  std::vector<ProgramTensors> program_tensors;
+  CVI_RT_MEM private_mem = nullptr;
+
+  // make program_id the default program of Forward APIs
+  void switchProgram() {
+    auto &t = program_tensors[program_id];
+    program = programs[program_id];
+    inputs = t.inputs;
+    outputs = t.outputs;
+    input_num = t.input_num;
+    output_num = t.output_num;
+  }
 };
 
 static void setChipTypeForCmodel(const char *modelFile, const int8_t *buf, size_t size) {
@@ -77,99 +133,224 @@ static void setChipTypeForCmodelFd(const int fd, const size_t ud_offset) {
 #endif
 }
 
-//According to the file descriptor and user defined offset to construct model.
-CVI_RC CVI_NN_RegisterModelFromFd(const int fd, const size_t ud_offset, CVI_MODEL_HANDLE *model) {
+// Create a model instance, the CviModel is shared with previous
+// registrations of the same content if cache_key is not empty.
+// It doesn't touch global context, so it can run without g_ctx_mutex.
+static CVI_RC createModelInstance(CVI_RT_HANDLE ctx, const std::string &cache_key,
+                                  const std::function<CVI_RC(CviModel *)> &acquire,
+                                  CVI_MODEL_HANDLE *model) {
   *model = NULL;
-  const std::lock_guard<std::mutex> lock(g_ctx_mutex);
-
-  if (!g_ctx) {
-    setChipTypeForCmodelFd(fd, ud_offset);
-    CVI_RT_Init(&g_ctx);
+  CviModel *_model = nullptr;
+  if (!cache_key.empty()) {
+    _model = lookupCachedModel(cache_key);
   }
-
-  auto _model = new CviModel(g_ctx, g_model_count++);
   if (!_model) {
-    TPU_LOG_ERROR("failed to create a CviModel Instance\n");
-    return CVI_RC_FAILURE;
-  }
-  CVI_RC ret = _model->acquire(fd, ud_offset);
-  if (ret != CVI_RC_SUCCESS) {
-    _model->release();
-    return ret;
+    _model = new CviModel(ctx, g_model_count++);
+    if (!_model) {
+      TPU_LOG_ERROR("failed to create a CviModel Instance\n");
+      if (!cache_key.empty()) {
+        abandonCachedModel(cache_key);
+      }
+      return CVI_RC_FAILURE;
+    }
+    CVI_RC ret = acquire(_model);
+    if (ret != CVI_RC_SUCCESS) {
+      _model->release();
+      if (!cache_key.empty()) {
+        abandonCachedModel(cache_key);
+      }
+      return ret;
+    }
+    if (!cache_key.empty()) {
+      insertCachedModel(cache_key, _model);
+    }
   }
   auto instance = new ModelInstance(_model);
   if (!instance) {
     _model->release();
     return CVI_RC_FAILURE;
   }
-
-  g_ctx_ref_count++;
   *model = (void *)instance;
   return CVI_RC_SUCCESS;
 }
 
-CVI_RC CVI_NN_RegisterModel(const char *modelFile, CVI_MODEL_HANDLE *model) {
-  *model = NULL;
+// Take a reference of global context, create it if needed.
+static CVI_RT_HANDLE acquireContext(const std::function<void()> &initChipType) {
   const std::lock_guard<std::mutex> lock(g_ctx_mutex);
-
   if (!g_ctx) {
-    setChipTypeForCmodel(modelFile, nullptr, 0);
+    initChipType();
     CVI_RT_Init(&g_ctx);
   }
+  g_ctx_ref_count++;
+  return g_ctx;
+}
 
-  auto _model = new CviModel(g_ctx, g_model_count++);
-  if (!_model) {
-    TPU_LOG_ERROR("failed to create a CviModel Instance\n");
-    return CVI_RC_FAILURE;
+static void releaseContext() {
+  const std::lock_guard<std::mutex> lock(g_ctx_mutex);
+  g_ctx_ref_count--;
+  if (g_ctx_ref_count == 0) {
+    CVI_RT_DeInit(g_ctx);
+    g_ctx = nullptr;
   }
-  CVI_RC ret = _model->acquire(modelFile);
+}
+
+// Global lock is only held to create/reference the context, models
+// registered by different threads are parsed and loaded concurrently.
+static CVI_RC registerModel(const std::string &cache_key,
+                            const std::function<void()> &initChipType,
+                            const std::function<CVI_RC(CviModel *)> &acquire,
+                            CVI_MODEL_HANDLE *model) {
+  *model = NULL;
+  CVI_RT_HANDLE ctx = acquireContext(initChipType);
+  CVI_RC ret = createModelInstance(ctx, cache_key, acquire, model);
   if (ret != CVI_RC_SUCCESS) {
-    _model->release();
-    return ret;
-  }
-  auto instance = new ModelInstance(_model);
-  if (!instance) {
-    _model->release();
-    return CVI_RC_FAILURE;
+    releaseContext();
   }
+  return ret;
+}
 
-  g_ctx_ref_count++;
-  *model = (void *)instance;
+struct RegisterTask {
+  std::thread worker;
+  std::atomic<bool> done;
+  CVI_RC ret = CVI_RC_UNINIT;
+  CVI_MODEL_HANDLE model = nullptr;
+};
+
+// The context is created on the calling thread, so the initialization
+// order is the same as the calls. Model is loaded on a worker thread
+// without holding g_ctx_mutex.
+static CVI_RC registerModelAsync(const std::string &cache_key,
+                                 const std::function<void()> &initChipType,
+                                 const std::function<CVI_RC(CviModel *)> &acquire,
+                                 CVI_REGISTER_HANDLE *handle) {
+  *handle = NULL;
+  auto task = new RegisterTask;
+  if (!task) {
+    return CVI_RC_NOMEM;
+  }
+  task->done = false;
+  CVI_RT_HANDLE ctx = acquireContext(initChipType);
+  task->worker = std::thread([task, ctx, cache_key, acquire]() {
+    task->ret = createModelInstance(ctx, cache_key, acquire, &task->model);
+    if (task->ret != CVI_RC_SUCCESS) {
+      releaseContext();
+    }
+    task->done = true;
+  });
+  *handle = (void *)task;
   return CVI_RC_SUCCESS;
 }
 
-CVI_RC CVI_NN_RegisterModelFromBuffer(const int8_t *buf, uint32_t size,
-                                      CVI_MODEL_HANDLE *model) {
-  *model = NULL;
-  const std::lock_guard<std::mutex> lock(g_ctx_mutex);
-
-  if (!g_ctx) {
-    setChipTypeForCmodel(nullptr, buf, size);
-    CVI_RT_Init(&g_ctx);
+static uint32_t registerFlagsFromEnv() {
+  uint32_t flags = 0;
+  const char *mmap_env = std::getenv("TPU_ENABLE_MMAP");
+  if (mmap_env && atoi(mmap_env) > 0) {
+    flags |= CVI_NN_REGISTER_MMAP;
   }
+  return flags;
+}
 
-  auto _model = new CviModel(g_ctx, g_model_count++);
-  if (!_model) {
-    TPU_LOG_ERROR("failed to create a CviModel Instance\n");
-    return CVI_RC_FAILURE;
+//According to the file descriptor and user defined offset to construct model.
+CVI_RC CVI_NN_RegisterModelFromFd(const int fd, const size_t ud_offset, CVI_MODEL_HANDLE *model) {
+  return CVI_NN_RegisterModelFromFdWithFlags(fd, ud_offset, 0, model);
+}
+
+CVI_RC CVI_NN_RegisterModelFromFdWithFlags(const int fd, const size_t ud_offset,
+                                           uint32_t flags, CVI_MODEL_HANDLE *model) {
+  std::string key;
+  if (!(flags & CVI_NN_REGISTER_NO_CACHE) && modelCacheEnabled()) {
+    key = modelCacheKeyOfFd(fd, ud_offset);
   }
-  CVI_RC ret = _model->acquire(buf, size);
-  if (ret != CVI_RC_SUCCESS) {
-    _model->release();
-    return ret;
+  return registerModel(key,
+      [&]() { setChipTypeForCmodelFd(fd, ud_offset); },
+      [&](CviModel *m) { return m->acquire(fd, ud_offset); },
+      model);
+}
+
+CVI_RC CVI_NN_RegisterModel(const char *modelFile, CVI_MODEL_HANDLE *model) {
+  return CVI_NN_RegisterModelWithFlags(modelFile, registerFlagsFromEnv(), model);
+}
+
+CVI_RC CVI_NN_RegisterModelWithFlags(const char *modelFile, uint32_t flags,
+                                     CVI_MODEL_HANDLE *model) {
+  std::string key;
+  if (!(flags & CVI_NN_REGISTER_NO_CACHE) && modelCacheEnabled()) {
+    key = modelCacheKeyOfFile(modelFile);
   }
-  auto instance = new ModelInstance(_model);
-  if (!instance) {
-    _model->release();
-    return CVI_RC_FAILURE;
+  return registerModel(key,
+      [&]() { setChipTypeForCmodel(modelFile, nullptr, 0); },
+      [&](CviModel *m) {
+        return m->acquire(modelFile, flags & CVI_NN_REGISTER_MMAP,
+                          !(flags & CVI_NN_REGISTER_EAGER));
+      },
+      model);
+}
+
+CVI_RC CVI_NN_RegisterModelFromBuffer(const int8_t *buf, uint32_t size,
+                                      CVI_MODEL_HANDLE *model) {
+  return CVI_NN_RegisterModelFromBufferWithFlags(buf, size, 0, model);
+}
+
+CVI_RC CVI_NN_RegisterModelFromBufferWithFlags(const int8_t *buf, uint32_t size,
+                                               uint32_t flags, CVI_MODEL_HANDLE *model) {
+  std::string key;
+  if (!(flags & CVI_NN_REGISTER_NO_CACHE) && modelCacheEnabled()) {
+    key = modelCacheKeyOfBuffer(buf, size);
   }
+  return registerModel(key,
+      [&]() { setChipTypeForCmodel(nullptr, buf, size); },
+      [&](CviModel *m) { return m->acquire(buf, size); },
+      model);
+}
 
-  g_ctx_ref_count++;
-  *model = (void *)instance;
-  return CVI_RC_SUCCESS;
+CVI_RC CVI_NN_RegisterModelAsync(const char *modelFile, CVI_REGISTER_HANDLE *handle) {
+  uint32_t flags = registerFlagsFromEnv();
+  std::string file(modelFile);
+  std::string key = modelCacheEnabled() ? modelCacheKeyOfFile(modelFile) : "";
+  return registerModelAsync(key,
+      [&]() { setChipTypeForCmodel(modelFile, nullptr, 0); },
+      [file, flags](CviModel *m) {
+        return m->acquire(file, flags & CVI_NN_REGISTER_MMAP,
+                          !(flags & CVI_NN_REGISTER_EAGER));
+      },
+      handle);
+}
+
+CVI_RC CVI_NN_RegisterModelFromBufferAsync(const int8_t *buf, uint32_t size,
+                                           CVI_REGISTER_HANDLE *handle) {
+  std::string key = modelCacheEnabled() ? modelCacheKeyOfBuffer(buf, size) : "";
+  return registerModelAsync(key,
+      [&]() { setChipTypeForCmodel(nullptr, buf, size); },
+      [buf, size](CviModel *m) { return m->acquire(buf, size); },
+      handle);
+}
+
+CVI_RC CVI_NN_RegisterModelFromFdAsync(const int fd, const size_t ud_offset,
+                                       CVI_REGISTER_HANDLE *handle) {
+  std::string key = modelCacheEnabled() ? modelCacheKeyOfFd(fd, ud_offset) : "";
+  return registerModelAsync(key,
+      [&]() { setChipTypeForCmodelFd(fd, ud_offset); },
+      [fd, ud_offset](CviModel *m) { return m->acquire(fd, ud_offset); },
+      handle);
 }
 
+CVI_RC CVI_NN_RegisterModelWait(CVI_REGISTER_HANDLE handle, CVI_MODEL_HANDLE *model) {
+  auto task = (struct RegisterTask *)handle;
+  task->worker.join();
+  CVI_RC ret = task->ret;
+  *model = task->model;
+  delete task;
+  return ret;
+}
 
+CVI_RC CVI_NN_RegisterModelPoll(CVI_REGISTER_HANDLE handle, CVI_MODEL_HANDLE *model) {
+  auto task = (struct RegisterTask *)handle;
+  if (!task->done) {
+    *model = NULL;
+    return CVI_RC_AGAIN;
+  }
+  return CVI_NN_RegisterModelWait(handle, model);
+}
 
 CVI_RC CVI_NN_CloneModel(CVI_MODEL_HANDLE model, CVI_MODEL_HANDLE *clonedModel) {
   const std::lock_guard<std::mutex> lock(g_ctx_mutex);
@@ -184,6 +365,42 @@ CVI_RC CVI_NN_CloneModel(CVI_MODEL_HANDLE model, CVI_MODEL_HANDLE *clonedModel)
   return CVI_RC_SUCCESS;
 }
 
+CVI_RC CVI_NN_CreateBatcher(CVI_MODEL_HANDLE model, int32_t max_delay_us,
+                            CVI_BATCHER_HANDLE *batcher) {
+  auto instance = (struct ModelInstance *)model;
+  if (!batcher || max_delay_us < 0) {
+    return CVI_RC_INVALID_ARG;
+  }
+  *batcher = NULL;
+  {
+    const std::lock_guard<std::mutex> lock(g_ctx_mutex);
+    ++g_ctx_ref_count;
+  }
+  auto _batcher = new Batcher(instance->model, max_delay_us);
+  CVI_RC ret = _batcher->init();
+  if (ret != CVI_RC_SUCCESS) {
+    delete _batcher;
+    releaseContext();
+    return ret;
+  }
+  *batcher = (void *)_batcher;
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_BatcherForward(CVI_BATCHER_HANDLE batcher, CVI_TENSOR inputs[],
+                             int32_t input_num, CVI_TENSOR outputs[],
+                             int32_t output_num) {
+  return ((Batcher *)batcher)->forward(inputs, input_num, outputs, output_num);
+}
+
+CVI_RC CVI_NN_DestroyBatcher(CVI_BATCHER_HANDLE batcher) {
+  if (batcher) {
+    delete (Batcher *)batcher;
+    releaseContext();
+  }
+  return CVI_RC_SUCCESS;
+}
+
 CVI_RC CVI_NN_GetModelVersion(CVI_MODEL_HANDLE model, int32_t *major, int32_t *minor) {
   auto instance = (struct ModelInstance *)model;
   *major = instance->model->major_ver;
@@ -191,11 +408,46 @@ CVI_RC CVI_NN_GetModelVersion(CVI_MODEL_HANDLE model, int32_t *major, int32_t *m
   return CVI_RC_SUCCESS;
 }
 
+CVI_RC CVI_NN_GetLoadStats(CVI_MODEL_HANDLE model, CVI_LOAD_STATS *stats,
+                           CVI_LOAD_SECTION_STAT *sections, int32_t max_section_num) {
+  auto instance = (struct ModelInstance *)model;
+  if (!stats) {
+    return CVI_RC_INVALID_ARG;
+  }
+  instance->model->loadProfile().get(stats, sections, max_section_num);
+
+  // the profile of model is shared by clones and cache hits,
+  // programs are owned by the handle and counted separately.
+  std::vector<cvi::runtime::Program *> programs(instance->programs);
+  if (programs.empty() && instance->program) {
+    programs.push_back(instance->program);
+  }
+  if (instance->pipeline_program) {
+    programs.push_back(instance->pipeline_program);
+  }
+  for (auto p : programs) {
+    stats->phases[CVI_LOAD_PHASE_PROGRAM].time_us += p->load_time_us;
+    stats->phases[CVI_LOAD_PHASE_NEURON_MAP].time_us += p->neuron_map_time_us;
+    stats->phases[CVI_LOAD_PHASE_CPU_FUNC_SETUP].time_us += p->cpu_setup_time_us;
+    stats->total_us += p->load_time_us;
+  }
+  return CVI_RC_SUCCESS;
+}
+
 const char *CVI_NN_GetModelTarget(CVI_MODEL_HANDLE model) {
   auto instance = (struct ModelInstance *)model;
   return instance->model->targetChipType.c_str();
 }
 
+CVI_RC CVI_NN_GetModelContext(CVI_MODEL_HANDLE model, void **ctx) {
+  auto instance = (struct ModelInstance *)model;
+  if (!instance || !ctx) {
+    return CVI_RC_INVALID_ARG;
+  }
+  *ctx = instance->model->context();
+  return CVI_RC_SUCCESS;
+}
+
 CVI_RC CVI_NN_SetConfig(CVI_MODEL_HANDLE model, CVI_CONFIG_OPTION option, ...) {
   va_list valist;
   auto instance = (struct ModelInstance *)model;
@@ -211,6 +463,15 @@ CVI_RC CVI_NN_SetConfig(CVI_MODEL_HANDLE model, CVI_CONFIG_OPTION option, ...) {
     case OPTION_PROGRAM_INDEX:
       instance->program_id = va_arg(valist, int32_t);
       assert(instance->program_id < instance->program_num);
+      if (!instance->programs.empty()) {
+        instance->switchProgram();
+      }
+      break;
+    case OPTION_ENABLE_PIPELINE:
+      instance->enable_pipeline = va_arg(valist, int32_t);
+      break;
+    case OPTION_MULTI_PROGRAM:
+      instance->multi_program = va_arg(valist, int32_t);
       break;
     case OPTION_SKIP_PREPROCESS:
     case OPTION_SKIP_POSTPROCESS:
@@ -228,11 +489,68 @@ CVI_RC CVI_NN_SetConfig(CVI_MODEL_HANDLE model, CVI_CONFIG_OPTION option, ...) {
   return CVI_RC_SUCCESS;
 }
 
+static CVI_RC createPipeline(struct ModelInstance *instance) {
+  if (!instance->program->pipelineable()) {
+    TPU_LOG_WARNING("program can't be pipelined, fallback to normal mode\n");
+    return CVI_RC_SUCCESS;
+  }
+  CVI_RC ret = instance->model->loadProgram(
+      &(instance->pipeline_program), instance->program_id,
+      instance->output_all_tensors_for_debug,
+      instance->skip_preprocess);
+  if (ret != CVI_RC_SUCCESS) {
+    TPU_LOG_ERROR("failed to load program for pipeline, ret:%d\n", ret);
+    return ret;
+  }
+  Program *slots[Pipeline::SLOT_NUM] = {instance->program, instance->pipeline_program};
+  instance->pipeline = new Pipeline(slots);
+  return CVI_RC_SUCCESS;
+}
+
+static CVI_RC loadAllPrograms(struct ModelInstance *instance) {
+  CVI_RC ret = instance->model->loadAllPrograms(
+      instance->programs, instance->output_all_tensors_for_debug,
+      instance->skip_preprocess, &instance->private_mem);
+  if (ret != CVI_RC_SUCCESS) {
+    TPU_LOG_ERROR("failed to load programs, ret:%d\n", ret);
+    return ret;
+  }
+  instance->program_tensors.resize(instance->programs.size());
+  for (size_t i = 0; i < instance->programs.size(); ++i) {
+    auto &t = instance->program_tensors[i];
+    t.inputs = instance->programs[i]->exportInputs(t.input_num);
+    t.outputs = instance->programs[i]->exportOutputs(t.output_num);
+    if (!t.inputs || !t.outputs) {
+      // leave the instance as if programs were never loaded
+      for (auto &pt : instance->program_tensors) {
+        delete[] pt.inputs;
+        delete[] pt.outputs;
+      }
+      instance->program_tensors.clear();
+      instance->model->unloadAllPrograms(instance->programs, instance->private_mem);
+      instance->private_mem = nullptr;
+      return CVI_RC_FAILURE;
+    }
+  }
+  instance->switchProgram();
+  return CVI_RC_SUCCESS;
+}
+
 CVI_RC CVI_NN_GetInputOutputTensors(CVI_MODEL_HANDLE model, CVI_TENSOR **inputs,
                               int32_t *input_num, CVI_TENSOR **outputs,
                               int32_t *output_num) {
   CVI_RC ret;
   auto instance = (struct ModelInstance *)model;
+  if (!instance->program && instance->multi_program) {
+    ret = loadAllPrograms(instance);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+    if (instance->enable_pipeline) {
+      TPU_LOG_WARNING("pipeline is not supported with multi program, ignored\n");
+      instance->enable_pipeline = false;
+    }
+  }
   if (!instance->program) {
     ret = instance->model->loadProgram(
         &(instance->program), instance->program_id,
@@ -244,14 +562,25 @@ CVI_RC CVI_NN_GetInputOutputTensors(CVI_MODEL_HANDLE model, CVI_TENSOR **inputs,
     }
   }
 
+  if (instance->enable_pipeline && !instance->pipeline) {
+    ret = createPipeline(instance);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+  }
+
   if (!instance->inputs) {
-    instance->inputs = instance->program->exportInputs(instance->input_num);
+    instance->inputs = instance->pipeline ?
+        instance->pipeline->exportInputs(instance->input_num) :
+        instance->program->exportInputs(instance->input_num);
     if (!instance->inputs) {
       return CVI_RC_FAILURE;
     }
   }
   if (!instance->outputs) {
-    instance->outputs = instance->program->exportOutputs(instance->output_num);
+    instance->outputs = instance->pipeline ?
+        instance->pipeline->exportOutputs(instance->output_num) :
+        instance->program->exportOutputs(instance->output_num);
     if (!instance->outputs) {
       return CVI_RC_FAILURE;
     }
@@ -271,34 +600,197 @@ CVI_RC CVI_NN_GetInputOutputTensors(CVI_MODEL_HANDLE model, CVI_TENSOR **inputs,
 CVI_RC CVI_NN_Forward(CVI_MODEL_HANDLE model, CVI_TENSOR inputs[], int32_t input_num,
                       CVI_TENSOR outputs[], int output_num) {
   auto instance = (struct ModelInstance *)model;
+  if (instance->pipeline) {
+    auto task = instance->pipeline->submit(inputs, input_num, outputs, output_num);
+    return instance->pipeline->wait(task);
+  }
   if (instance->program->forward(inputs, input_num, outputs, output_num))
     return CVI_RC_SUCCESS;
   return CVI_RC_FAILURE;
 }
 
+CVI_RC CVI_NN_GetProgramInputOutputTensors(CVI_MODEL_HANDLE model, int32_t program_id,
+                                           CVI_TENSOR **inputs, int32_t *input_num,
+                                           CVI_TENSOR **outputs, int32_t *output_num) {
+  auto instance = (struct ModelInstance *)model;
+  if (instance->programs.empty()) {
+    return CVI_RC_UNINIT;
+  }
+  if (program_id < 0 || program_id >= (int32_t)instance->programs.size()) {
+    return CVI_RC_INVALID_ARG;
+  }
+  auto &t = instance->program_tensors[program_id];
+  if (inputs)
+    *inputs = t.inputs;
+  if (input_num)
+    *input_num = t.input_num;
+  if (outputs)
+    *outputs = t.outputs;
+  if (output_num)
+    *output_num = t.output_num;
+  return CVI_RC_SUCCESS;
+}
+
+// The program with least input elements whose inputs can hold
+// tensors of given shapes.
+static int32_t selectProgram(struct ModelInstance *instance,
+                             const CVI_SHAPE shapes[], int32_t num) {
+  int32_t selected = -1;
+  size_t selected_count = 0;
+  for (size_t i = 0; i < instance->programs.size(); ++i) {
+    auto &ins = instance->programs[i]->input_tensors();
+    if ((int32_t)ins.size() != num) {
+      continue;
+    }
+    bool fit = true;
+    size_t count = 0;
+    for (int32_t j = 0; j < num && fit; ++j) {
+      auto &shape = ins[j]->shape;
+      for (size_t d = 0; d < shape.size(); ++d) {
+        int32_t dim = d < shapes[j].dim_size ? shapes[j].dim[d] : 1;
+        if (dim > shape[d]) {
+          fit = false;
+          break;
+        }
+      }
+      count += ins[j]->count();
+    }
+    if (fit && (selected < 0 || count < selected_count)) {
+      selected = i;
+      selected_count = count;
+    }
+  }
+  return selected;
+}
+
+CVI_RC CVI_NN_SelectProgram(CVI_MODEL_HANDLE model, const CVI_SHAPE shapes[],
+                            int32_t input_num, int32_t *program_id) {
+  auto instance = (struct ModelInstance *)model;
+  if (instance->programs.empty()) {
+    return CVI_RC_UNINIT;
+  }
+  if (!shapes || !program_id) {
+    return CVI_RC_INVALID_ARG;
+  }
+  *program_id = selectProgram(instance, shapes, input_num);
+  return *program_id < 0 ? CVI_RC_DATA_ERR : CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_ForwardProgram(CVI_MODEL_HANDLE model, int32_t program_id,
+                             CVI_TENSOR inputs[], int32_t input_num,
+                             CVI_TENSOR outputs[], int32_t output_num) {
+  auto instance = (struct ModelInstance *)model;
+  if (instance->programs.empty()) {
+    return CVI_RC_UNINIT;
+  }
+  if (program_id < 0) {
+    std::vector<CVI_SHAPE> shapes(input_num);
+    for (int32_t i = 0; i < input_num; ++i) {
+      shapes[i] = inputs[i].shape;
+    }
+    program_id = selectProgram(instance, shapes.data(), input_num);
+    if (program_id < 0) {
+      TPU_LOG_ERROR("no program fits shapes of inputs\n");
+      return CVI_RC_DATA_ERR;
+    }
+  }
+  if (program_id >= (int32_t)instance->programs.size()) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (instance->programs[program_id]->forward(inputs, input_num, outputs, output_num))
+    return CVI_RC_SUCCESS;
+  return CVI_RC_FAILURE;
+}
+
 CVI_RC CVI_NN_ForwardAsync(CVI_MODEL_HANDLE model, CVI_TENSOR inputs[], int input_num,
                            CVI_TENSOR outputs[], int output_num, void **taskNo) {
   auto instance = (struct ModelInstance *)model;
-  *taskNo = instance->program->forwardAsync(inputs, input_num, outputs, output_num);
+  if (instance->pipeline) {
+    *taskNo = instance->pipeline->submit(inputs, input_num, outputs, output_num,
+                                         nullptr, nullptr, nullptr, instance->event_fd);
+    return CVI_RC_SUCCESS;
+  }
+  *taskNo = instance->program->forwardAsync(inputs, input_num, outputs, output_num,
+                                            nullptr, nullptr, nullptr, instance->event_fd);
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_ForwardAsyncWithCallback(CVI_MODEL_HANDLE model, CVI_TENSOR inputs[],
+                                       int input_num, CVI_TENSOR outputs[], int output_num,
+                                       CVI_NN_FORWARD_CALLBACK callback, void *user_data) {
+  auto instance = (struct ModelInstance *)model;
+  if (!callback) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (instance->pipeline) {
+    instance->pipeline->submit(inputs, input_num, outputs, output_num,
+                               callback, model, user_data, instance->event_fd);
+    return CVI_RC_SUCCESS;
+  }
+  instance->program->forwardAsync(inputs, input_num, outputs, output_num,
+                                  callback, model, user_data, instance->event_fd);
   return CVI_RC_SUCCESS;
 }
 
 CVI_RC CVI_NN_ForwardWait(CVI_MODEL_HANDLE model, void *taskNo) {
   auto instance = (struct ModelInstance *)model;
+  if (instance->pipeline) {
+    return instance->pipeline->wait(taskNo);
+  }
   return instance->program->forwardWait(taskNo);
 }
 
+CVI_RC CVI_NN_ForwardPoll(CVI_MODEL_HANDLE model, void *taskNo) {
+  auto instance = (struct ModelInstance *)model;
+  if (instance->pipeline) {
+    return instance->pipeline->poll(taskNo);
+  }
+  return instance->program->forwardPoll(taskNo);
+}
+
+CVI_RC CVI_NN_GetCacheStats(CVI_MODEL_HANDLE model, uint64_t *flushed_bytes,
+                            uint64_t *invalidated_bytes) {
+  auto instance = (struct ModelInstance *)model;
+  if (!instance->program) {
+    return CVI_RC_UNINIT;
+  }
+  auto &stats = instance->program->cache_stats;
+  if (flushed_bytes)
+    *flushed_bytes = stats.flushed;
+  if (invalidated_bytes)
+    *invalidated_bytes = stats.invalidated;
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_GetCompletionFd(CVI_MODEL_HANDLE model, int32_t *fd) {
+  auto instance = (struct ModelInstance *)model;
+  if (!fd) {
+    return CVI_RC_INVALID_ARG;
+  }
+  int cur = instance->event_fd.load();
+  if (cur < 0) {
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+      TPU_LOG_ERROR("failed to create eventfd, errno:%d\n", errno);
+      return CVI_RC_FAILURE;
+    }
+    // another thread may have created it meanwhile
+    if (instance->event_fd.compare_exchange_strong(cur, efd)) {
+      cur = efd;
+    } else {
+      close(efd);
+    }
+  }
+  *fd = cur;
+  return CVI_RC_SUCCESS;
+}
+
 CVI_RC CVI_NN_CleanupModel(CVI_MODEL_HANDLE model) {
   if (model) {
     delete (struct ModelInstance *)model;
   }
 
-  const std::lock_guard<std::mutex> lock(g_ctx_mutex);
-  g_ctx_ref_count--;
-  if (g_ctx_ref_count == 0) {
-    CVI_RT_DeInit(g_ctx);
-    g_ctx = nullptr;
-  }
+  releaseContext();
   return CVI_RC_SUCCESS;
 }
 
@@ -399,6 +891,223 @@ CVI_RC CVI_NN_SetTensorPhysicalAddr(CVI_TENSOR *tensor, uint64_t paddr) {
   return CVI_RC_FAILURE;
 }
 
+CVI_RC CVI_NN_BindOutputBuffer(CVI_MODEL_HANDLE model, CVI_TENSOR *tensor,
+                               uint64_t paddr, void *vaddr) {
+  auto instance = (struct ModelInstance *)model;
+  if (!tensor || !paddr || !vaddr) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (!instance->program || tensor->owner != instance->program) {
+    TPU_LOG_ERROR("tensor %s doesn't belong to model\n", tensor->name);
+    return CVI_RC_INVALID_ARG;
+  }
+  // outputs of pipelined mode are staged, see Pipeline::exportOutputs()
+  if (instance->pipeline) {
+    return CVI_RC_UNSUPPORT;
+  }
+  CVI_RC ret = instance->program->bindOutput(tensor->name, paddr, (uint8_t *)vaddr);
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+  tensor->sys_mem = (uint8_t *)vaddr;
+  tensor->paddr = paddr;
+  tensor->mem_type = CVI_MEM_SYSTEM;
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_BindStateTensor(CVI_MODEL_HANDLE model, const char *output_name,
+                              const char *input_name) {
+  auto instance = (struct ModelInstance *)model;
+  if (!output_name || !input_name) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (!instance->program) {
+    return CVI_RC_UNINIT;
+  }
+  // the two programs of pipelined mode don't share states.
+  if (instance->pipeline) {
+    return CVI_RC_UNSUPPORT;
+  }
+  return instance->program->bindState(output_name, input_name);
+}
+
+CVI_RC CVI_NN_ResetState(CVI_MODEL_HANDLE model) {
+  auto instance = (struct ModelInstance *)model;
+  if (!instance->program) {
+    return CVI_RC_UNINIT;
+  }
+  instance->program->resetStates();
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_Warmup(CVI_MODEL_HANDLE model) {
+  auto instance = (struct ModelInstance *)model;
+  CVI_RC ret = CVI_NN_GetInputOutputTensors(model, nullptr, nullptr, nullptr, nullptr);
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+  std::vector<Program *> programs = instance->programs;
+  if (programs.empty()) {
+    programs.push_back(instance->program);
+    if (instance->pipeline_program) {
+      programs.push_back(instance->pipeline_program);
+    }
+  }
+  for (auto program : programs) {
+    for (auto &input : program->input_tensors()) {
+      input->warmup();
+    }
+  }
+  return CVI_RC_SUCCESS;
+}
+
+static CVI_TENSOR *findInstanceTensor(CVI_TENSOR *tensors, int32_t num,
+                                      const char *name) {
+  for (int32_t i = 0; i < num; ++i) {
+    if (strcmp(tensors[i].name, name) == 0) {
+      return &tensors[i];
+    }
+  }
+  return nullptr;
+}
+
+CVI_RC CVI_NN_ChainTensor(CVI_MODEL_HANDLE src_model, const char *output_name,
+                          CVI_MODEL_HANDLE dst_model, const char *input_name) {
+  auto src = (struct ModelInstance *)src_model;
+  auto dst = (struct ModelInstance *)dst_model;
+  if (!output_name || !input_name || src == dst) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (!src->program || !dst->program) {
+    return CVI_RC_UNINIT;
+  }
+  // tensors of pipelined mode are staged.
+  if (src->pipeline || dst->pipeline) {
+    return CVI_RC_UNSUPPORT;
+  }
+  auto output = findInstanceTensor(src->outputs, src->output_num, output_name);
+  auto input = findInstanceTensor(dst->inputs, dst->input_num, input_name);
+  if (!output || !input) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (output->mem_size != input->mem_size || output->fmt != input->fmt) {
+    TPU_LOG_ERROR("can't chain %s to %s, size or fmt mismatch\n",
+                  output_name, input_name);
+    return CVI_RC_DATA_ERR;
+  }
+  std::shared_ptr<Neuron> neuron;
+  for (auto &n : src->program->output_tensors()) {
+    if (n->name == output_name) {
+      neuron = n;
+    }
+  }
+  // output must be written by tpu into io mem of its own,
+  // which is then read by dst model in place.
+  if (!neuron || neuron->baseAddrIndex() < 3 || !neuron->sys_mem() ||
+      output->sys_mem != neuron->sys_mem() ||
+      src->program->writtenByCpu(neuron)) {
+    return CVI_RC_UNSUPPORT;
+  }
+  CVI_RC ret = dst->program->bindInput(input_name, neuron->paddr(), neuron->sys_mem());
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+  input->sys_mem = neuron->sys_mem();
+  input->paddr = neuron->paddr();
+  input->mem_type = CVI_MEM_SYSTEM;
+  return CVI_RC_SUCCESS;
+}
+
+struct GraphInstance {
+  cvi::runtime::Graph graph;
+  std::vector<struct ModelInstance *> models;
+};
+
+CVI_RC CVI_NN_CreateGraph(CVI_GRAPH_HANDLE *graph) {
+  if (!graph) {
+    return CVI_RC_INVALID_ARG;
+  }
+  *graph = (void *)new GraphInstance;
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_GraphAddModel(CVI_GRAPH_HANDLE graph, CVI_MODEL_HANDLE model,
+                            int32_t *node_id) {
+  auto g = (struct GraphInstance *)graph;
+  auto instance = (struct ModelInstance *)model;
+  if (!g || !instance || !node_id) {
+    return CVI_RC_INVALID_ARG;
+  }
+  CVI_RC ret = CVI_NN_GetInputOutputTensors(model, nullptr, nullptr, nullptr, nullptr);
+  if (ret != CVI_RC_SUCCESS) {
+    return ret;
+  }
+  *node_id = g->graph.addNode([model, instance]() {
+    return CVI_NN_Forward(model, instance->inputs, instance->input_num,
+                          instance->outputs, instance->output_num);
+  });
+  g->models.push_back(instance);
+  return CVI_RC_SUCCESS;
+}
+
+CVI_RC CVI_NN_GraphAddEdge(CVI_GRAPH_HANDLE graph, int32_t src_node, const char *output_name,
+                           int32_t dst_node, const char *input_name) {
+  auto g = (struct GraphInstance *)graph;
+  if (!g || src_node < 0 || dst_node < 0 ||
+      src_node >= (int32_t)g->models.size() || dst_node >= (int32_t)g->models.size()) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (!output_name || !input_name) {
+    // control dependency only
+    return g->graph.addEdge(src_node, dst_node);
+  }
+  auto src = g->models[src_node];
+  auto dst = g->models[dst_node];
+  CVI_RC ret = CVI_NN_ChainTensor(src, output_name, dst, input_name);
+  if (ret == CVI_RC_SUCCESS) {
+    return g->graph.addEdge(src_node, dst_node);
+  }
+  if (ret != CVI_RC_UNSUPPORT) {
+    return ret;
+  }
+  // can't be shared in device memory, copy it after src runs.
+  auto output = findInstanceTensor(src->outputs, src->output_num, output_name);
+  auto input = findInstanceTensor(dst->inputs, dst->input_num, input_name);
+  if (!output || !input) {
+    return CVI_RC_INVALID_ARG;
+  }
+  if (output->mem_size != input->mem_size) {
+    TPU_LOG_ERROR("can't copy %s to %s, size mismatch\n", output_name, input_name);
+    return CVI_RC_DATA_ERR;
+  }
+  TPU_LOG_WARNING("%s -> %s is copied by host\n", output_name, input_name);
+  return g->graph.addEdge(src_node, dst_node, [output, input]() {
+    memcpy(CVI_NN_TensorPtr(input), CVI_NN_TensorPtr(output),
+           CVI_NN_TensorSize(input));
+    return CVI_RC_SUCCESS;
+  });
+}
+
+CVI_RC CVI_NN_GraphRun(CVI_GRAPH_HANDLE graph, int32_t parallel) {
+  auto g = (struct GraphInstance *)graph;
+  if (!g) {
+    return CVI_RC_INVALID_ARG;
+  }
+  // models share one shared memory region unless it's a pool.
+  if (parallel && sharedMemSlotNum() == 0) {
+    TPU_LOG_WARNING("shared memory pool is disabled, graph runs serially\n");
+    parallel = 0;
+  }
+  return g->graph.run(parallel != 0);
+}
+
+CVI_RC CVI_NN_DestroyGraph(CVI_GRAPH_HANDLE graph) {
+  if (graph) {
+    delete (struct GraphInstance *)graph;
+  }
+  return CVI_RC_SUCCESS;
+}
+
 static std::shared_ptr<Neuron> findTargetInput(CVI_TENSOR *tensor) {
   auto program = static_cast<cvi::runtime::Program *>(tensor->owner);
   for (auto &input : program->input_tensors()) {
@@ -410,6 +1119,19 @@ static std::shared_ptr<Neuron> findTargetInput(CVI_TENSOR *tensor) {
   return nullptr;
 }
 
+// Frames are preloaded into neuron memory before forward, it would be
+// lost if the neuron lives in shared memory pool, as forward may run on
+// another slot, or the slot may be taken by other programs in between.
+static CVI_RC checkPreload(CVI_TENSOR *tensor, const std::shared_ptr<Neuron> &input) {
+  auto program = static_cast<cvi::runtime::Program *>(tensor->owner);
+  if (program->inSharedMemPool(input)) {
+    TPU_LOG_ERROR("preload input %s in shared memory pool is not supported\n",
+                  tensor->name);
+    return CVI_RC_UNSUPPORT;
+  }
+  return CVI_RC_SUCCESS;
+}
+
 CVI_RC CVI_NN_SetTensorWithVideoFrame(
     CVI_MODEL_HANDLE model, CVI_TENSOR* tensor,
     CVI_VIDEO_FRAME_INFO* video_frame_info) {
@@ -447,12 +1169,14 @@ CVI_RC CVI_NN_SetTensorWithVideoFrame(
   if (!tensor->aligned) {
     int c = input->isPacked() ? 1 : tensor->shape.dim[1];
     assert(c <= 3);
-    for (int i = 0; i < c; i++) {
-      ret = input->preloadChannelAndCompact(i, video_frame_info->pyaddr[i]);
-      if (ret != CVI_RC_SUCCESS) {
-        TPU_LOG_ERROR("CVI_NN_SetTensorWithVideoFrame fail!");
-        return ret;
-      }
+    ret = checkPreload(tensor, input);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+    ret = input->preloadChannels(video_frame_info->pyaddr, c);
+    if (ret != CVI_RC_SUCCESS) {
+      TPU_LOG_ERROR("CVI_NN_SetTensorWithVideoFrame fail!");
+      return ret;
     }
   } else {
     /* check y_align w_align channel_align
@@ -460,7 +1184,7 @@ CVI_RC CVI_NN_SetTensorWithVideoFrame(
        2.on cv183x yuv_420_planar's y_align is 64, w_align is 32
        3.on cv182x yuv_420_planar's y_align is 128, w_align is 64
     */
-    CVI_NN_SetTensorWithAlignedFrames(
+    return CVI_NN_SetTensorWithAlignedFrames(
         tensor, &(video_frame_info->pyaddr[0]), 1,
         video_frame_info->type);
   }
@@ -479,12 +1203,14 @@ CVI_RC CVI_NN_SetTensorWithAlignedFrames(
   CVI_RC ret = CVI_RC_SUCCESS;
 
   if (!tensor->aligned) {
-    for (int i = 0; i < frame_num; i++) {
-      ret = input->preloadFrameAndCompact(i, frame_paddrs[i]);
-      if (ret != CVI_RC_SUCCESS) {
-        TPU_LOG_ERROR("CVI_NN_SetTensorWithAlignedFrames unaligned fail!");
-        return ret;
-      }
+    ret = checkPreload(tensor, input);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+    ret = input->preloadFrames(frame_paddrs, frame_num);
+    if (ret != CVI_RC_SUCCESS) {
+      TPU_LOG_ERROR("CVI_NN_SetTensorWithAlignedFrames unaligned fail!");
+      return ret;
     }
   } else {
     // check pixel format
@@ -495,12 +1221,14 @@ CVI_RC CVI_NN_SetTensorWithAlignedFrames(
     if (frame_num == 1 && tensor->shape.dim[0] == 1) {
       CVI_NN_SetTensorPhysicalAddr(tensor, frame_paddrs[0]);
     } else {
-      for (int i = 0; i < frame_num; i++) {
-        ret = input->preload(i, frame_paddrs[i]);
-        if (ret != CVI_RC_SUCCESS) {
-            TPU_LOG_ERROR("CVI_NN_SetTensorWithAlignedFrames aligned fail!");
-            return ret;
-        }
+      ret = checkPreload(tensor, input);
+      if (ret != CVI_RC_SUCCESS) {
+        return ret;
+      }
+      ret = input->preloadFrames(frame_paddrs, frame_num);
+      if (ret != CVI_RC_SUCCESS) {
+        TPU_LOG_ERROR("CVI_NN_SetTensorWithAlignedFrames aligned fail!");
+        return ret;
       }
     }
   }
@@ -553,12 +1281,14 @@ CVI_RC CVI_NN_FeedTensorWithFrames(
   if (!tensor->aligned) {
     int c = input->isPacked() ? 1 : tensor->shape.dim[1];
     assert(channel_num <= c);
-    for (int i = 0; i < channel_num; i++) {
-      ret = input->preloadChannelAndCompact(i, channel_paddrs[i]);
-      if (ret != CVI_RC_SUCCESS) {
-        TPU_LOG_WARNING("FeedTensor failed\n");
-        return CVI_RC_FAILURE;
-      }
+    ret = checkPreload(tensor, input);
+    if (ret != CVI_RC_SUCCESS) {
+      return ret;
+    }
+    ret = input->preloadChannels(channel_paddrs, channel_num);
+    if (ret != CVI_RC_SUCCESS) {
+      TPU_LOG_WARNING("FeedTensor failed\n");
+      return CVI_RC_FAILURE;
     }
   } else {
     /* check y_align w_align channel_align
@@ -566,7 +1296,7 @@ CVI_RC CVI_NN_FeedTensorWithFrames(
        2.on cv183x yuv_420_planar's y_align is 64, w_align is 32
        3.on cv182x yuv_420_planar's y_align is 128, w_align is 64
     */
-    CVI_NN_SetTensorWithAlignedFrames(tensor, &(channel_paddrs[0]), 1, type);
+    return CVI_NN_SetTensorWithAlignedFrames(tensor, &(channel_paddrs[0]), 1, type);
   }
   return CVI_RC_SUCCESS;
 }
@@ -582,3 +1312,15 @@ void CVI_RT_Global_ResetMemAllocCallback() {
 void CVI_NN_Global_SetSharedMemorySize(size_t size) {
   setSharedMemSize(size);
 }
+
+void CVI_NN_Global_SetSharedMemorySlotNum(int num) {
+  setSharedMemSlotNum(num);
+}
+
+void CVI_NN_Global_SetLoadThreadNum(int num) {
+  CviModel::setLoadThreadNum(num);
+}
+
+void CVI_NN_Global_SetAsyncWorkerNum(int num) {
+  TaskPool::workerNum = num;
+}
@@ -4,11 +4,14 @@
 #include <iostream>
 #include <sstream>
 #include <mutex>
+#include <map>
+#include <inttypes.h>
 #include <linux/memfd.h>
 #include <asm/unistd.h>
 #include <runtime/debug.h>
 #include <runtime/section.hpp>
 #include <runtime/stream.hpp>
+#include <runtime/hash.hpp>
 
 #if defined(__aarch64__) || defined(__arm__) || (__GNUC__ < 6)
 #include <sys/syscall.h>
@@ -31,55 +34,140 @@ static inline int memfd_create(const char *name, unsigned int flags) {
 namespace cvi {
 namespace runtime {
 
-bool CustomFunctionSection::load(BaseStream *stream, size_t offset, size_t size,
-                                 std::vector<CpuRuntimeFunction *> &cpu_functions) {
-  char path[64];
-  uint8_t *buf = new uint8_t[size];
-  if (!buf) {
-    TPU_LOG_ERROR("Error, failed to allocate memory\n");
+struct CustomFunctionDso {
+  std::string key;
+  int ref = 0;
+  // memfd holding content of library, also used to confirm a hit of key
+  int shm_fd = -1;
+  void *handle = nullptr;
+  int func_num = 0;
+  CustomOpRuntimeFunc *funcs = nullptr;
+};
+
+static std::mutex gDsoLock;
+static std::map<std::string, CustomFunctionDso *> gDsoCache;
+
+static void closeDso(CustomFunctionDso *dso) {
+  if (dso->handle)
+    dlclose(dso->handle);
+  if (dso->shm_fd >= 0)
+    close(dso->shm_fd);
+  delete dso;
+}
+
+// compare the library with content of the memfd it was loaded from,
+// so no extra copy of the library is kept in heap.
+static bool sameContent(CustomFunctionDso *dso, const uint8_t *buf, size_t size) {
+  void *ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, dso->shm_fd, 0);
+  if (ptr == MAP_FAILED) {
+    TPU_LOG_WARNING("map custom function dso failed:%d\n", errno);
     return false;
   }
-  stream->read(buf, offset, size);
+  bool same = (memcmp(ptr, buf, size) == 0);
+  munmap(ptr, size);
+  return same;
+}
+
+static CustomFunctionDso *openDso(const std::string &key, uint8_t *buf, size_t size) {
+  char path[64];
+  auto dso = new CustomFunctionDso;
+  dso->key = key;
   // load function by dlopen.
-  shm_fd = memfd_create("cvitek", MFD_CLOEXEC);
-  if (-1 == write(shm_fd, buf, size)) {
-    TPU_LOG_ERROR("Error, write data to shared mem failed:%d\n", errno);
-    delete[] buf;
-    return false;
+  dso->shm_fd = memfd_create("cvitek", MFD_CLOEXEC);
+  for (size_t done = 0; done < size;) {
+    ssize_t n = write(dso->shm_fd, buf + done, size - done);
+    if (n < 0) {
+      TPU_LOG_ERROR("Error, write data to shared mem failed:%d\n", errno);
+      closeDso(dso);
+      return nullptr;
+    }
+    done += n;
   }
-  delete[] buf;
 
-  snprintf(path, sizeof(path), "/proc/%d/fd/%d", getpid(), shm_fd);
-  dso_handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
-  if (!dso_handle) {
+  snprintf(path, sizeof(path), "/proc/%d/fd/%d", getpid(), dso->shm_fd);
+  dso->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!dso->handle) {
     TPU_LOG_ERROR("Error, dlopen %s, %s\n", path, dlerror());
-    return false;
+    closeDso(dso);
+    return nullptr;
   }
 
-  auto num = (int *)dlsym(dso_handle, "customOpRuntimeFuncsNum");
+  auto num = (int *)dlsym(dso->handle, "customOpRuntimeFuncsNum");
   if (!num) {
     TPU_LOG_ERROR("Error, dlsym find 'customOpRuntimeFuncsNum' failed\n");
-    return false;
+    closeDso(dso);
+    return nullptr;
   }
 
-  auto custom_funcs = (CustomOpRuntimeFunc*)dlsym(dso_handle, "customOpRuntimeFuncs");
+  auto custom_funcs = (CustomOpRuntimeFunc*)dlsym(dso->handle, "customOpRuntimeFuncs");
   if (!custom_funcs) {
     TPU_LOG_ERROR("Error, dlsym find 'customOpRuntimeFuncs' failed\n");
+    closeDso(dso);
+    return nullptr;
+  }
+  dso->func_num = *num;
+  dso->funcs = custom_funcs;
+  return dso;
+}
+
+bool CustomFunctionSection::load(BaseStream *stream, size_t offset, size_t size,
+                                 std::vector<CpuRuntimeFunction *> &cpu_functions) {
+  uint8_t *buf = new uint8_t[size];
+  if (!buf) {
+    TPU_LOG_ERROR("Error, failed to allocate memory\n");
+    return false;
+  }
+  if (stream->read(buf, offset, size) != size) {
+    TPU_LOG_ERROR("Error, failed to read custom function section\n");
+    delete[] buf;
     return false;
   }
 
-  for (int i = 0; i < (*num); i++) {
+  char key[64];
+  snprintf(key, sizeof(key), "%zu:%016" PRIx64, size, contentHash(buf, size));
+
+  CustomFunctionDso *dso = nullptr;
+  {
+    const std::lock_guard<std::mutex> lock(gDsoLock);
+    auto it = gDsoCache.find(key);
+    if (it != gDsoCache.end() && sameContent(it->second, buf, size)) {
+      dso = it->second;
+      TPU_LOG_DEBUG("reuse custom function dso %s\n", key);
+    } else {
+      dso = openDso(key, buf, size);
+      // on collision of key, the library is opened but not cached
+      if (dso && it == gDsoCache.end()) {
+        gDsoCache[key] = dso;
+      }
+    }
+    if (dso) {
+      dso->ref++;
+    }
+  }
+  delete[] buf;
+  if (!dso) {
+    return false;
+  }
+  _dsos.push_back(dso);
+
+  for (int i = 0; i < dso->func_num; i++) {
     cpu_functions.push_back(
-        new CpuRuntimeFunction(custom_funcs[i].name, custom_funcs[i].func));
+        new CpuRuntimeFunction(dso->funcs[i].name, dso->funcs[i].func));
   }
   return true;
 }
 
 CustomFunctionSection::~CustomFunctionSection() {
-  if (dso_handle)
-    dlclose(dso_handle);
-  if (shm_fd)
-    close(shm_fd);
+  const std::lock_guard<std::mutex> lock(gDsoLock);
+  for (auto dso : _dsos) {
+    if (--dso->ref == 0) {
+      auto it = gDsoCache.find(dso->key);
+      if (it != gDsoCache.end() && it->second == dso) {
+        gDsoCache.erase(it);
+      }
+      closeDso(dso);
+    }
+  }
 }
 
 } // namespace runtime
@@ -1,6 +1,8 @@
 #include <inttypes.h>
 #include <list>
+#include <map>
 #include <mutex>
+#include <condition_variable>
 #include <iostream>
 #include <sstream>
 #include <runtime/debug.h>
@@ -14,6 +16,13 @@ namespace runtime {
 static std::mutex gMutexLock;
 static std::list<CVI_RT_MEM> gSharedMemList;
 static size_t gMaxSharedMemSize = 0;
+// number of programs referring shared memory
+static int gSharedMemUsers = 0;
+// 0 means programs use shared memory without arbitration,
+// otherwise mems in gSharedMemList are slots of a pool.
+static int gSlotNum = 0;
+static std::map<CVI_RT_MEM, bool> gSlotBusy;
+static std::condition_variable gSlotCond;
 
 void setSharedMemSize(size_t size) {
   #define PAGESIZE 4096
@@ -23,6 +32,26 @@ void setSharedMemSize(size_t size) {
   gMaxSharedMemSize = std::max(gMaxSharedMemSize, size);
 }
 
+void setSharedMemSlotNum(int num) {
+  const std::lock_guard<std::mutex> lock(gMutexLock);
+  gSlotNum = std::max(num, 0);
+}
+
+int sharedMemSlotNum() {
+  const std::lock_guard<std::mutex> lock(gMutexLock);
+  return gSlotNum;
+}
+
+// keep list sorted by size, in descending order.
+static void insertSharedMem(CVI_RT_MEM mem) {
+  auto size = CVI_RT_MemGetSize(mem);
+  auto it = gSharedMemList.begin();
+  while (it != gSharedMemList.end() && CVI_RT_MemGetSize(*it) >= size) {
+    ++it;
+  }
+  gSharedMemList.insert(it, mem);
+}
+
 CVI_RT_MEM allocateSharedMemory(CVI_RT_HANDLE ctx, size_t size) {
   const std::lock_guard<std::mutex> lock(gMutexLock);
   size = std::max(gMaxSharedMemSize, size);
@@ -32,6 +61,7 @@ CVI_RT_MEM allocateSharedMemory(CVI_RT_HANDLE ctx, size_t size) {
       TPU_LOG_DEBUG("find shared memory(%" PRIu64 "),  saved:%zu \n",
                     CVI_RT_MemGetSize(mem), size);
       CVI_RT_MemIncRef(mem);
+      gSharedMemUsers++;
       return mem;
     }
   }
@@ -43,18 +73,8 @@ CVI_RT_MEM allocateSharedMemory(CVI_RT_HANDLE ctx, size_t size) {
     return nullptr;
   }
   CVI_RT_MemIncRef(mem);
-  if (gSharedMemList.empty()) {
-    gSharedMemList.push_back(mem);
-  } else {
-    for (auto it = gSharedMemList.begin();
-        it != gSharedMemList.end();
-        ++it) {
-      if (CVI_RT_MemGetSize(*it) < size) {
-        gSharedMemList.insert(it, mem);
-        break;
-      }
-    }
-  }
+  gSharedMemUsers++;
+  insertSharedMem(mem);
   return mem;
 }
 
@@ -62,11 +82,21 @@ void deallocateSharedMemory(CVI_RT_HANDLE ctx, CVI_RT_MEM mem) {
   const std::lock_guard<std::mutex> lock(gMutexLock);
   for (auto candidate : gSharedMemList) {
     if (candidate == mem) {
-      // if ref drops to 0, free it.
-      if (CVI_RT_MemDecRef(mem) == 0) {
+      gSharedMemUsers--;
+      // if ref drops to 0, free it. Slots of pool are kept until no
+      // program refers shared memory, as others may run on them.
+      if (CVI_RT_MemDecRef(mem) == 0 && gSlotNum == 0) {
         gSharedMemList.remove(mem);
+        gSlotBusy.erase(mem);
         cviMemFree(ctx, mem);
       }
+      if (gSharedMemUsers == 0) {
+        for (auto m : gSharedMemList) {
+          cviMemFree(ctx, m);
+        }
+        gSharedMemList.clear();
+        gSlotBusy.clear();
+      }
       // otherwise, do nothing.
       return;
     }
@@ -75,6 +105,44 @@ void deallocateSharedMemory(CVI_RT_HANDLE ctx, CVI_RT_MEM mem) {
   cviMemFree(ctx, mem);
 }
 
+CVI_RT_MEM acquireSharedMemSlot(CVI_RT_HANDLE ctx, size_t size) {
+  std::unique_lock<std::mutex> lock(gMutexLock);
+  size = std::max(gMaxSharedMemSize, size);
+  while (true) {
+    int num = 0;
+    for (auto &mem : gSharedMemList) {
+      if (CVI_RT_MemGetSize(mem) < size) {
+        continue;
+      }
+      if (!gSlotBusy[mem]) {
+        gSlotBusy[mem] = true;
+        return mem;
+      }
+      ++num;
+    }
+    // all slots big enough are busy, add one if budget allows.
+    if (num < gSlotNum) {
+      CVI_RT_MEM mem = cviMemAlloc(ctx, size, CVI_ALLOC_SHARED, "SharedMemory");
+      if (!mem) {
+        TPU_LOG_WARNING("failed to alloc shared memory slot, size:%zu\n", size);
+        if (num == 0) {
+          return nullptr;
+        }
+      } else {
+        insertSharedMem(mem);
+        gSlotBusy[mem] = true;
+        return mem;
+      }
+    }
+    gSlotCond.wait(lock);
+  }
+}
+
+void releaseSharedMemSlot(CVI_RT_MEM mem) {
+  const std::lock_guard<std::mutex> lock(gMutexLock);
+  gSlotBusy[mem] = false;
+  gSlotCond.notify_all();
+}
+
 } // namespace runtime
 } // namespace cvi
-
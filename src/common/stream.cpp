@@ -5,32 +5,59 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
 #include <runtime/stream.hpp>
 
 namespace cvi {
 namespace runtime {
 
+// pread until size bytes are read, the file offset of fd is not
+// changed, so it can be called from several threads.
+static size_t preadFull(int fd, uint8_t *buf, size_t size, off_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = pread(fd, buf + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      TPU_LOG_ERROR("read %zu bytes at %ld failed, got %zu\n", size,
+                    (long)offset, done);
+      break;
+    }
+    done += n;
+  }
+  return done;
+}
+
 FileStream::FileStream(const std::string& file_name) {
-  _fstream = new std::ifstream(file_name, std::ifstream::binary);
-  if (!_fstream->good()) {
+  _fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (_fd < 0) {
     TPU_LOG_ERROR("Error, Failed to open %s\n", file_name.c_str());
     return;
   }
-  _fstream->seekg(0, _fstream->end);
-  _length = _fstream->tellg();
-  _fstream->seekg(0, _fstream->beg);
+  struct stat st;
+  if (fstat(_fd, &st) != 0) {
+    TPU_LOG_ERROR("Error, Failed to stat %s\n", file_name.c_str());
+    return;
+  }
+  _length = st.st_size;
 }
 
 FileStream::~FileStream() {
-  if (_fstream)
-    delete _fstream;
+  if (_fd >= 0)
+    close(_fd);
 }
 
 size_t FileStream::read(uint8_t *buf, size_t offset, size_t size) {
   TPU_ASSERT(offset + size <= _length, "model is incomplete or incorrect!");
-  _fstream->seekg(offset);
-  _fstream->read((char *)buf, size);
-  return size;
+  return preadFull(_fd, buf, size, offset);
+}
+
+void FileStream::readahead(size_t offset, size_t size) {
+  posix_fadvise(_fd, offset, size, POSIX_FADV_WILLNEED);
 }
 
 BufferStream::BufferStream(const int8_t *buf, size_t size)
@@ -53,9 +80,69 @@ FdStream::FdStream(const int fd, const size_t ud_offset) {
 size_t FdStream::read(uint8_t *buf, size_t offset, size_t size) {
   TPU_ASSERT(offset + size <= _length, "model is incomplete or incorrect!");
   //when reading add user_define_offset to the offset
-  lseek(file_descriptor, offset + user_define_offset, SEEK_SET);
-  size_t sz = ::read(file_descriptor, buf, size);
-  return sz;
+  return preadFull(file_descriptor, buf, size, offset + user_define_offset);
+}
+
+void FdStream::readahead(size_t offset, size_t size) {
+  posix_fadvise(file_descriptor, offset + user_define_offset, size,
+                POSIX_FADV_WILLNEED);
+}
+
+MmapStream::MmapStream(const std::string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    TPU_LOG_ERROR("Error, Failed to open %s\n", file_name.c_str());
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    TPU_LOG_ERROR("Error, Failed to stat %s\n", file_name.c_str());
+    close(fd);
+    return;
+  }
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping holds its own reference to the file
+  close(fd);
+  if (addr == MAP_FAILED) {
+    TPU_LOG_ERROR("Error, Failed to mmap %s\n", file_name.c_str());
+    return;
+  }
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+  _addr = (uint8_t *)addr;
+  _length = st.st_size;
+}
+
+MmapStream::~MmapStream() {
+  if (_addr)
+    munmap(_addr, _length);
+}
+
+size_t MmapStream::read(uint8_t *buf, size_t offset, size_t size) {
+  TPU_ASSERT(offset + size <= _length, "model is incomplete or incorrect!");
+  memcpy(buf, _addr + offset, size);
+  // sections are consumed once, give the page cache back early
+  dropPages(offset, size);
+  return size;
+}
+
+const uint8_t *MmapStream::data(size_t offset, size_t size) {
+  TPU_ASSERT(offset + size <= _length, "model is incomplete or incorrect!");
+  return _addr + offset;
+}
+
+void MmapStream::readahead(size_t offset, size_t size) {
+  size_t page_size = (size_t)getpagesize();
+  size_t begin = offset & ~(page_size - 1);
+  madvise(_addr + begin, offset + size - begin, MADV_WILLNEED);
+}
+
+void MmapStream::dropPages(size_t offset, size_t size) {
+  size_t page_size = (size_t)getpagesize();
+  size_t begin = (offset + page_size - 1) & ~(page_size - 1);
+  size_t end = (offset + size) & ~(page_size - 1);
+  if (end > begin) {
+    madvise(_addr + begin, end - begin, MADV_DONTNEED);
+  }
 }
 
 } // namespace runtime
@@ -2,17 +2,72 @@
 #include <unistd.h>
 #include <iostream>
 #include <mutex>
+#include <stdlib.h>
+#include <errno.h>
 #include <runtime/taskpool.hpp>
 #include <runtime/model.hpp>
 
 namespace cvi {
 namespace runtime {
 
-Task::Task(TaskPool *pool, void *program, CVI_TENSOR *inputs,
-           int input_num, CVI_TENSOR *outputs, int output_num)
-    : program(program), input_num(input_num), output_num(output_num),
-      inputs(inputs), outputs(outputs) {
-  pool->addTask(this);
+void signalEventFd(int fd) {
+  uint64_t one = 1;
+  while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+}
+
+int TaskPool::workerNum = 0;
+
+int TaskPool::getWorkerNum() {
+  if (workerNum > 0) {
+    return workerNum;
+  }
+  const char *env = std::getenv("TPU_ASYNC_WORKERS");
+  if (env && atoi(env) > 0) {
+    return atoi(env);
+  }
+  return 1;
+}
+
+void Task::reset(void *program, CVI_TENSOR *inputs, int input_num,
+                 CVI_TENSOR *outputs, int output_num,
+                 CVI_NN_FORWARD_CALLBACK callback,
+                 void *model, void *user_data, int event_fd) {
+  this->program = program;
+  this->inputs = inputs;
+  this->input_num = input_num;
+  this->outputs = outputs;
+  this->output_num = output_num;
+  this->callback = callback;
+  this->model = model;
+  this->user_data = user_data;
+  this->event_fd = event_fd;
+  this->retCode = CVI_RC_UNINIT;
+}
+
+void Task::complete(CVI_RC ret) {
+  int fd;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    fd = event_fd;
+    retCode = ret;
+    _cond.notify_one();
+  }
+  if (fd >= 0) {
+    signalEventFd(fd);
+  }
+}
+
+CVI_RC Task::poll() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return (retCode == CVI_RC_UNINIT) ? CVI_RC_AGAIN : retCode;
+}
+
+CVI_RC Task::wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (retCode == CVI_RC_UNINIT)
+    _cond.wait(lock);
+  return retCode;
 }
 
 TaskPool::~TaskPool() {
@@ -27,6 +82,9 @@ TaskPool::~TaskPool() {
       }
     }
   }
+  for (auto task : _all_tasks) {
+    delete task;
+  }
 }
 
 void TaskPool::startPool() {
@@ -34,6 +92,9 @@ void TaskPool::startPool() {
     return;
   }
   std::unique_lock<std::mutex> lock(_mutex);
+  if (!_threads.empty()) {
+    return;
+  }
   for (int i = 0; i < _pool_size; ++i) {
     _threads.push_back(std::thread(run, this));
   }
@@ -42,6 +103,40 @@ void TaskPool::startPool() {
   }
 }
 
+Task *TaskPool::acquireTask() {
+  std::unique_lock<std::mutex> lock(_task_mutex);
+  if (!_free_tasks.empty()) {
+    auto task = _free_tasks.back();
+    _free_tasks.pop_back();
+    return task;
+  }
+  auto task = new Task();
+  _all_tasks.push_back(task);
+  return task;
+}
+
+void TaskPool::releaseTask(Task *task) {
+  std::unique_lock<std::mutex> lock(_task_mutex);
+  _free_tasks.push_back(task);
+}
+
+// Tasks of same program share the neuron memory and must complete in
+// submission order, so they are queued in the program. Only the first
+// task of an idle program is put to the pool, the worker taking it
+// drains the queue of that program, other workers serve other programs.
+void TaskPool::addTask(Task *task) {
+  auto program = (Program *)task->program;
+  {
+    std::unique_lock<std::mutex> lock(program->async_mutex);
+    program->async_queue.push_back(task);
+    if (program->async_running) {
+      return;
+    }
+    program->async_running = true;
+  }
+  _queue.put(task);
+}
+
 void TaskPool::workFunc() {
   _started = true;
   while (!_done) {
@@ -49,17 +144,44 @@ void TaskPool::workFunc() {
     if (task == nullptr)
       continue;
     auto program = (Program *)task->program;
-    task->retCode = (CVI_RC)program->forward(task->inputs, task->input_num, task->outputs,
-                                     task->output_num);
-    std::unique_lock<std::mutex> lock(_mutex);
-    _cond_feedback.notify_all();
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(program->async_mutex);
+        if (program->async_queue.empty()) {
+          program->async_running = false;
+          break;
+        }
+        task = program->async_queue.front();
+        program->async_queue.pop_front();
+      }
+      CVI_RC ret = program->forward(task->inputs, task->input_num, task->outputs,
+                                    task->output_num) ? CVI_RC_SUCCESS : CVI_RC_FAILURE;
+      if (task->callback) {
+        int event_fd = task->event_fd;
+        task->callback(task->model, ret, task->user_data);
+        releaseTask(task);
+        if (event_fd >= 0) {
+          signalEventFd(event_fd);
+        }
+      } else {
+        task->complete(ret);
+      }
+    }
   }
 }
 
-void TaskPool::waitTask(Task *task) {
-  std::unique_lock<std::mutex> lock(_mutex);
-  while (task->retCode == CVI_RC_UNINIT)
-    _cond_feedback.wait(lock);
+CVI_RC TaskPool::waitTask(Task *task) {
+  CVI_RC ret = task->wait();
+  releaseTask(task);
+  return ret;
+}
+
+CVI_RC TaskPool::pollTask(Task *task) {
+  CVI_RC ret = task->poll();
+  if (ret != CVI_RC_AGAIN) {
+    releaseTask(task);
+  }
+  return ret;
 }
 
 }
@@ -911,6 +911,39 @@ bmerr_t CviDeviceMem::run_cmdbuf_ex2(bmctx_t ctx, bmmem_device_t cmdbuf_mem, uin
   return ret ? BM_ERR_FAILURE : BM_SUCCESS;
 }
 
+// Copy header and cpu descriptors of a relocated dmabuf. Descriptors
+// hold absolute addresses of tiu/tdma commands, so the copy runs the
+// commands of original dmabuf, with its own arraybase fields. Users of
+// a shared dmabuf can then submit with different base addresses without
+// rewriting the shared header.
+bmerr_t CviDeviceMem::dup_dmabuf_header(bmctx_t ctx, bmmem_device_t dmabuf_mem,
+                                        bmmem_device_t *header_mem)
+{
+  dma_hdr_t *header = (dma_hdr_t *)(dmabuf_mem->v_addr);
+  if (header->dmabuf_magic_m != tpu_dmabuf_header_m) {
+    TPU_LOG_ERROR("dup dmabuf header:magic check fail!\n");
+    return BM_ERR_FAILURE;
+  }
+  size_t sz = sizeof(dma_hdr_t) + header->cpu_desc_count * sizeof(cvi_cpu_desc_t);
+  bmmem_device_t mem = protect ? mem_alloc_pagesize(ctx, sz) : mem_alloc_raw(ctx, sz);
+  if (!mem) {
+    return BM_ERR_NOMEM;
+  }
+  memcpy(mem->v_addr, dmabuf_mem->v_addr, sz);
+  dma_hdr_t *copy = (dma_hdr_t *)(mem->v_addr);
+  copy->dmabuf_size = sz;
+  // pmu data are kept in original dmabuf.
+  copy->pmubuf_size = 0;
+  copy->pmubuf_offset = 0;
+  bmerr_t ret = mem_flush_ext(ctx->dev, mem->dma_fd, mem->p_addr, sz);
+  if (ret != BM_SUCCESS) {
+    mem_free_raw(ctx, mem);
+    return ret;
+  }
+  *header_mem = mem;
+  return BM_SUCCESS;
+}
+
 bmerr_t CviDeviceMem::run_async(bmctx_t ctx, bmmem_device_t cmdbuf_mem)
 {
   uint16_t seq_no_current = 0;
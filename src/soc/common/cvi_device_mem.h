@@ -82,6 +82,8 @@ public:
   virtual bmerr_t run_cmdbuf_ex2(bmctx_t ctx, bmmem_device_t cmdbuf_mem, uint16_t *seq_no,
                        cvi_array_base *p_array_base);
   virtual bmerr_t run_async(bmctx_t ctx, bmmem_device_t cmdbuf_mem);
+  virtual bmerr_t dup_dmabuf_header(bmctx_t ctx, bmmem_device_t dmabuf_mem,
+                                    bmmem_device_t *header_mem);
   virtual bmerr_t send_cmdbuf(bmctx_t ctx, uint8_t *cmdbuf, size_t sz, uint16_t *seq_no);
   virtual bmerr_t wait_cmdbuf_done(bmctx_t ctx, uint16_t seq_no);
   virtual bmerr_t wait_cmdbuf_all(bmctx_t ctx);
@@ -229,6 +229,15 @@ CVI_RC CviRTSoc::RunCmdbufEx(
   return (CVI_RC)cvi_device->wait_cmdbuf_done((bmctx_t)rt_handle, seq_no);
 }
 
+CVI_RC CviRTSoc::DupDmabufHeader(
+    CVI_RT_HANDLE rt_handle, CVI_RT_MEM dmabuf_mem,
+    CVI_RT_MEM *header_mem)
+{
+  return (CVI_RC)cvi_device->dup_dmabuf_header(
+                    (bmctx_t)rt_handle, (bmmem_device_t)dmabuf_mem,
+                    (bmmem_device_t *)header_mem);
+}
+
 CVI_RT_MEM CviRTSoc::MemAlloc(CVI_RT_HANDLE rt_handle, uint64_t size)
 {
   return (CVI_RT_MEM)cvi_device->mem_alloc_raw((bmctx_t)rt_handle, size);
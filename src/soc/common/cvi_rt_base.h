@@ -47,6 +47,8 @@ public:
                            uint64_t gaddr_base2, uint64_t gaddr_base3)                 = 0;
   virtual CVI_RC RunCmdbufEx(CVI_RT_HANDLE rt_handle, CVI_RT_MEM cmdbuf_mem,
                              CVI_RT_ARRAYBASE *p_array_base)                           = 0;
+  virtual CVI_RC DupDmabufHeader(CVI_RT_HANDLE rt_handle, CVI_RT_MEM dmabuf_mem,
+                                 CVI_RT_MEM *header_mem)                               = 0;
   virtual CVI_RC LoadCmdbufTee(CVI_RT_HANDLE rt_handle, uint8_t *cmdbuf,
                                size_t sz, uint64_t neuron_gaddr,
                                uint64_t weight_gaddr, uint32_t weight_len,
@@ -107,6 +109,8 @@ public:
   virtual CVI_RC RunCmdbufEx(
       CVI_RT_HANDLE rt_handle, CVI_RT_MEM cmdbuf_mem,
       CVI_RT_ARRAYBASE *p_array_base);
+  virtual CVI_RC DupDmabufHeader(CVI_RT_HANDLE rt_handle, CVI_RT_MEM dmabuf_mem,
+                                 CVI_RT_MEM *header_mem) override;
   virtual CVI_RT_MEM MemAlloc(CVI_RT_HANDLE rt_handle, uint64_t size) override;
   virtual CVI_RT_MEM MemPreAlloc(CVI_RT_MEM mem, uint64_t offset, uint64_t size) override;
   virtual void MemFree(CVI_RT_HANDLE rt_hanlde, CVI_RT_MEM mem) override;
@@ -106,6 +106,13 @@ CVI_RC CVI_RT_RunCmdbufEx(
   return cvi_chip->RunCmdbufEx(rt_handle, cmdbuf_mem, p_array_base);
 }
 
+CVI_RC CVI_RT_DupDmabufHeader(
+    CVI_RT_HANDLE rt_handle, CVI_RT_MEM dmabuf_mem,
+    CVI_RT_MEM *header_mem)
+{
+  return cvi_chip->DupDmabufHeader(rt_handle, dmabuf_mem, header_mem);
+}
+
 CVI_RC CVI_RT_LoadCmdbufTee(
     CVI_RT_HANDLE rt_handle, uint8_t *cmdbuf,
     size_t sz, uint64_t neuron_gaddr, uint64_t weight_gaddr, uint32_t weight_len, CVI_RT_MEM *cmdbuf_mem)
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <sys/time.h>
+#include <cviruntime_context.h>
+#include <runtime/debug.h>
+#include "cviruntime.h"
+#include <runtime/version.h>
+#include "argparse.hpp"
+#include "assert.h"
+
+#define EXIT_IF_ERROR(cond, statement)       \
+  if ((cond)) {                              \
+    printf("%s\n", statement);               \
+    exit(1);                                 \
+  }
+
+static std::string optModelFile;
+static int32_t optThreads = 8;
+static int32_t optRequests = 100;
+static int32_t optMaxDelayUs = 2000;
+static int32_t optProgramIndex = 0;
+
+static long elapsedUs(struct timeval &t0, struct timeval &t1) {
+  return (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec;
+}
+
+// tensors of one sample, in system memory
+struct Sample {
+  Sample(CVI_TENSOR *tensors, int32_t num) {
+    for (int i = 0; i < num; ++i) {
+      CVI_TENSOR t = tensors[i];
+      t.mem_size = t.mem_size / t.shape.dim[0];
+      t.shape.dim[0] = 1;
+      t.count = t.count / tensors[i].shape.dim[0];
+      t.mem_type = CVI_MEM_SYSTEM;
+      buffers.emplace_back(t.mem_size);
+      t.sys_mem = buffers.back().data();
+      t.paddr = 0;
+      this->tensors.push_back(t);
+    }
+    for (auto &buf : buffers) {
+      for (size_t i = 0; i < buf.size(); ++i) {
+        buf[i] = (uint8_t)rand();
+      }
+    }
+  }
+  std::vector<std::vector<uint8_t>> buffers;
+  std::vector<CVI_TENSOR> tensors;
+};
+
+struct Result {
+  long total_us;
+  std::vector<long> latencies;
+};
+
+// every thread forwards on its own cloned handle, one sample
+// per forward.
+static Result runDirect(CVI_MODEL_HANDLE model) {
+  std::vector<std::thread> threads;
+  std::vector<std::vector<long>> latencies(optThreads);
+  struct timeval t0, t1;
+  gettimeofday(&t0, NULL);
+  for (int i = 0; i < optThreads; ++i) {
+    threads.emplace_back([model, &latencies, i]() {
+      CVI_MODEL_HANDLE clone;
+      CVI_RC ret = CVI_NN_CloneModel(model, &clone);
+      EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to clone cvimodel");
+      CVI_NN_SetConfig(clone, OPTION_PROGRAM_INDEX, optProgramIndex);
+      CVI_TENSOR *inputs, *outputs;
+      int32_t input_num, output_num;
+      ret = CVI_NN_GetInputOutputTensors(clone, &inputs, &input_num,
+                                         &outputs, &output_num);
+      EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to get inputs & outputs from model");
+      for (int j = 0; j < optRequests; ++j) {
+        struct timeval s0, s1;
+        gettimeofday(&s0, NULL);
+        ret = CVI_NN_Forward(clone, inputs, input_num, outputs, output_num);
+        EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "forward failed");
+        gettimeofday(&s1, NULL);
+        latencies[i].push_back(elapsedUs(s0, s1));
+      }
+      CVI_NN_CleanupModel(clone);
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  gettimeofday(&t1, NULL);
+  Result result;
+  result.total_us = elapsedUs(t0, t1);
+  for (auto &l : latencies) {
+    result.latencies.insert(result.latencies.end(), l.begin(), l.end());
+  }
+  return result;
+}
+
+// every thread submits single samples to a shared batcher.
+static Result runBatched(CVI_MODEL_HANDLE model, CVI_TENSOR *inputs, int32_t input_num,
+                         CVI_TENSOR *outputs, int32_t output_num) {
+  CVI_BATCHER_HANDLE batcher;
+  CVI_RC ret = CVI_NN_CreateBatcher(model, optMaxDelayUs, &batcher);
+  EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to create batcher");
+
+  std::vector<std::thread> threads;
+  std::vector<std::vector<long>> latencies(optThreads);
+  struct timeval t0, t1;
+  gettimeofday(&t0, NULL);
+  for (int i = 0; i < optThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      Sample in(inputs, input_num);
+      Sample out(outputs, output_num);
+      for (int j = 0; j < optRequests; ++j) {
+        struct timeval s0, s1;
+        gettimeofday(&s0, NULL);
+        CVI_RC ret = CVI_NN_BatcherForward(batcher, in.tensors.data(), input_num,
+                                           out.tensors.data(), output_num);
+        EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "batcher forward failed");
+        gettimeofday(&s1, NULL);
+        latencies[i].push_back(elapsedUs(s0, s1));
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  gettimeofday(&t1, NULL);
+  CVI_NN_DestroyBatcher(batcher);
+
+  Result result;
+  result.total_us = elapsedUs(t0, t1);
+  for (auto &l : latencies) {
+    result.latencies.insert(result.latencies.end(), l.begin(), l.end());
+  }
+  return result;
+}
+
+static void report(const char *name, Result &result, int samples_per_request) {
+  auto &l = result.latencies;
+  std::sort(l.begin(), l.end());
+  long sum = 0;
+  for (auto e : l) {
+    sum += e;
+  }
+  double fps = (double)l.size() * samples_per_request * 1000000.0 / result.total_us;
+  printf("  %-8s %10.1f samples/s, latency avg %8.3f ms, p50 %8.3f ms, p99 %8.3f ms\n",
+         name, fps, (double)sum / l.size() / 1000.0, l[l.size() / 2] / 1000.0,
+         l[std::min(l.size() - 1, l.size() * 99 / 100)] / 1000.0);
+}
+
+int main(int argc, const char **argv) {
+  showRuntimeVersion();
+
+  argparse::ArgumentParser parser;
+  parser.addArgument("-m", "--model", 1, false); // required
+  parser.addArgument("-t", "--threads", 1);
+  parser.addArgument("-n", "--requests", 1); // requests per thread
+  parser.addArgument("-d", "--max-delay", 1); // in us
+  parser.addArgument("-p", "--program-index", 1); // program used by direct mode
+  parser.parse(argc, argv);
+
+  optModelFile = parser.retrieve<std::string>("model");
+  if (parser.gotArgument("threads")) {
+    optThreads = parser.retrieve<int>("threads");
+  }
+  if (parser.gotArgument("requests")) {
+    optRequests = parser.retrieve<int>("requests");
+  }
+  if (parser.gotArgument("max-delay")) {
+    optMaxDelayUs = parser.retrieve<int>("max-delay");
+  }
+  if (parser.gotArgument("program-index")) {
+    optProgramIndex = parser.retrieve<int>("program-index");
+  }
+
+  CVI_MODEL_HANDLE model = nullptr;
+  CVI_RC ret = CVI_NN_RegisterModel(optModelFile.c_str(), &model);
+  EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to register cvimodel");
+  CVI_NN_SetConfig(model, OPTION_PROGRAM_INDEX, optProgramIndex);
+  CVI_TENSOR *inputs, *outputs;
+  int32_t input_num, output_num;
+  ret = CVI_NN_GetInputOutputTensors(model, &inputs, &input_num, &outputs, &output_num);
+  EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to get inputs & outputs from model");
+  int batch = inputs[0].shape.dim[0];
+
+  auto direct = runDirect(model);
+  auto batched = runBatched(model, inputs, input_num, outputs, output_num);
+
+  printf("%d threads x %d requests, max delay %d us:\n", optThreads, optRequests,
+         optMaxDelayUs);
+  report("direct", direct, batch);
+  report("batched", batched, 1);
+  CVI_NN_CleanupModel(model);
+  return 0;
+}
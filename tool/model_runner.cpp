@@ -5,6 +5,7 @@
 #include "similarity.hpp"
 #include <cviruntime_context.h>
 #include <fstream>
+#include <inttypes.h>
 #include <iostream>
 #include <math.h>
 #include <runtime/debug.h>
@@ -24,6 +25,8 @@ static int32_t optProgramId = 0;
 static int32_t optInferenceCount = 1;
 static bool optEnableTimer = false;
 static bool optDumpAllTensors = false;
+static bool optLoadStats = false;
+static bool optPreloadBench = false;
 static float optCosineTolerance = 0.99f;
 static float optCorrelationTolerance = 0.99f;
 static float optEuclideanTolerance = 0.90f;
@@ -415,6 +418,99 @@ static void dumpTensorsInfo(
   }
 }
 
+static void dumpLoadStats(CVI_MODEL_HANDLE model) {
+  static const char *phase_names[CVI_LOAD_PHASE_NUM] = {
+      "parse", "custom func", "weight", "cmdbuf", "decompress",
+      "cpu weight map", "program", "neuron map", "cpu func setup"};
+  CVI_LOAD_STATS stats;
+  CVI_NN_GetLoadStats(model, &stats, nullptr, 0);
+  std::vector<CVI_LOAD_SECTION_STAT> sections(stats.section_num);
+  CVI_NN_GetLoadStats(model, &stats, sections.data(), stats.section_num);
+
+  printf("Load stats: total %.3f ms\n", stats.total_us / 1000.0);
+  for (int i = 0; i < CVI_LOAD_PHASE_NUM; ++i) {
+    printf("  [%-14s] %10.3f ms %12" PRIu64 " bytes\n", phase_names[i],
+           stats.phases[i].time_us / 1000.0, stats.phases[i].bytes);
+  }
+  for (auto &s : sections) {
+    printf("  section %-24s type:%d %10.3f ms %12" PRIu64 " -> %" PRIu64 " bytes\n",
+           s.name, s.type, s.time_us / 1000.0, s.size, s.loaded_size);
+  }
+}
+
+static long elapsedUs(const struct timeval &t0, const struct timeval &t1) {
+  return (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec;
+}
+
+// Feed a batch of frames in device memory into input tensor, one
+// submission per frame vs. one submission for the whole batch. There is
+// no api to preload a single frame into frame i of a batch, so single
+// frame submissions all land in frame 0, which only measures the cost
+// of submitting frames one by one.
+static void benchmarkPreload(CVI_MODEL_HANDLE model, CVI_TENSOR *tensor, int count) {
+  int n = tensor->shape.dim[0];
+  if (tensor->pixel_format == CVI_NN_PIXEL_TENSOR || n < 2) {
+    printf("Preload result: input %s is not a batch of frames, skipped\n",
+           tensor->name);
+    return;
+  }
+  // w of vpss buffer is aligned by 32 on cv183x, 64 on others.
+  size_t w_align = strcmp(CVI_NN_GetModelTarget(model), "cv183x") == 0 ? 32 : 64;
+  size_t frame_size;
+  if (tensor->aligned) {
+    frame_size = (CVI_NN_TensorSize(tensor) / n + w_align - 1) / w_align * w_align;
+  } else {
+    int packed = (tensor->pixel_format == CVI_NN_PIXEL_BGR_PACKED ||
+                  tensor->pixel_format == CVI_NN_PIXEL_RGB_PACKED ||
+                  tensor->pixel_format == CVI_NN_PIXEL_PACKED);
+    size_t c = packed ? 1 : tensor->shape.dim[1];
+    size_t h = packed ? tensor->shape.dim[1] : tensor->shape.dim[2];
+    size_t w = packed ? tensor->shape.dim[2] * tensor->shape.dim[3] : tensor->shape.dim[3];
+    size_t elem_size = CVI_NN_TensorSize(tensor) / CVI_NN_TensorCount(tensor);
+    frame_size = c * h * ((w + w_align - 1) / w_align * w_align) * elem_size;
+  }
+
+  // frames are allocated from the context of model.
+  CVI_RT_HANDLE ctx = nullptr;
+  CVI_RC ret = CVI_NN_GetModelContext(model, &ctx);
+  EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to get context of model");
+  std::vector<CVI_RT_MEM> frames;
+  std::vector<uint64_t> paddrs;
+  for (int i = 0; i < n; ++i) {
+    auto mem = CVI_RT_MemAlloc(ctx, frame_size);
+    EXIT_IF_ERROR(!mem, "failed to alloc frame");
+    frames.push_back(mem);
+    paddrs.push_back(CVI_RT_MemGetPAddr(mem));
+  }
+
+  // JIT cmdbufs of both paths ahead of timing.
+  ret = CVI_NN_SetTensorWithAlignedFrames(tensor, &paddrs[0], 1, tensor->pixel_format);
+  EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to preload frames");
+  ret = CVI_NN_SetTensorWithAlignedFrames(tensor, paddrs.data(), n, tensor->pixel_format);
+  EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to preload frames");
+
+  struct timeval t0, t1, t2;
+  gettimeofday(&t0, NULL);
+  for (int k = 0; k < count; ++k) {
+    for (int i = 0; i < n; ++i) {
+      CVI_NN_SetTensorWithAlignedFrames(tensor, &paddrs[i], 1, tensor->pixel_format);
+    }
+  }
+  gettimeofday(&t1, NULL);
+  for (int k = 0; k < count; ++k) {
+    CVI_NN_SetTensorWithAlignedFrames(tensor, paddrs.data(), n, tensor->pixel_format);
+  }
+  gettimeofday(&t2, NULL);
+  printf("Preload result: batch %d, %d single frame submissions (all to frame 0) "
+         "take %.3f ms, batched submission takes %.3f ms\n", n, n,
+         elapsedUs(t0, t1) / 1000.0 / count, elapsedUs(t1, t2) / 1000.0 / count);
+
+  for (auto mem : frames) {
+    CVI_RT_MemFree(ctx, mem);
+  }
+  tensor->mem_type = CVI_MEM_SYSTEM;
+}
+
 int main(int argc, const char **argv) {
   showRuntimeVersion();
 
@@ -434,6 +530,8 @@ int main(int argc, const char **argv) {
   parser.addArgument("--dump-all-tensors");
   parser.addArgument("--load-from-memory");
   parser.addArgument("--enable-timer");
+  parser.addArgument("--load-stats");
+  parser.addArgument("--preload-bench");
   parser.parse(argc, argv);
 
   if (parser.gotArgument("input")) {
@@ -483,6 +581,12 @@ int main(int argc, const char **argv) {
   if (parser.gotArgument("enable-timer")) {
     optEnableTimer = true;
   }
+  if (parser.gotArgument("load-stats")) {
+    optLoadStats = true;
+  }
+  if (parser.gotArgument("preload-bench")) {
+    optPreloadBench = true;
+  }
 
   CVI_MODEL_HANDLE model = NULL;
   CVI_RC ret;
@@ -513,6 +617,9 @@ int main(int argc, const char **argv) {
 
   dumpTensorsInfo(input_tensors, input_num,
                   output_tensors, output_num);
+  if (optLoadStats) {
+    dumpLoadStats(model);
+  }
   if (optInputFile.empty() == false) {
     loadInput(optInputFile, input_tensors, input_num);
   }
@@ -557,6 +664,10 @@ int main(int argc, const char **argv) {
     }
   }
 
+  if (optPreloadBench) {
+    benchmarkPreload(model, &input_tensors[0], optInferenceCount);
+  }
+
   if (!optOutputFile.empty()) {
     saveResultToNpz(optOutputFile, output_tensors, output_num);
   }
@@ -11,6 +11,7 @@
 #include <random>
 #include <cmath>
 #include <mutex>
+#include <atomic>
 #include <sys/time.h>
 #include <cviruntime_context.h>
 #include <runtime/debug.h>
@@ -23,6 +24,72 @@ static int g_infer_cnt;
 static std::string g_model_file;
 static std::mutex g_ctx_mutex;
 static CVI_MODEL_HANDLE g_model_handle = nullptr;
+// in exact mode, inputs are generated from a few fixed seeds, and
+// outputs of each thread must equal the ones of single thread run.
+static bool g_exact = false;
+static const int g_seed_num = 4;
+static std::vector<std::vector<std::vector<uint8_t>>> g_ref_outputs;
+static std::atomic<int> g_mismatch_cnt(0);
+
+static void fill_inputs(CVI_TENSOR *input_tensors, int32_t input_num,
+                        std::mt19937 &gen) {
+  for (int i = 0; i < input_num; i++) {
+    CVI_TENSOR *tensor = &input_tensors[i];
+    if (tensor->fmt == CVI_FMT_FP32) {
+      std::normal_distribution<float> d{0.3, 0.2};
+      float *data = (float *)CVI_NN_TensorPtr(tensor);
+      for (int i = 0; i < (int)CVI_NN_TensorCount(tensor); i++) {
+        float rand = d(gen);
+        rand = rand < 0 ? 0 : rand;
+        rand = rand > 1 ? 1 : rand;
+        data[i] = rand;
+      }
+    } else {
+      std::normal_distribution<float> d{50, 50};
+      int8_t *data = (int8_t *)CVI_NN_TensorPtr(tensor);
+      for (int i = 0; i < (int)CVI_NN_TensorCount(tensor); i++) {
+        float rand = std::round(d(gen));
+        rand = rand < 0 ? 0 : rand;
+        rand = rand > 127 ? 127 : rand;
+        data[i] = (int8_t)rand;
+      }
+    }
+  }
+}
+
+static void generate_references() {
+  CVI_RC ret = CVI_NN_RegisterModel(g_model_file.c_str(), &g_model_handle);
+  assert(ret == CVI_RC_SUCCESS);
+  CVI_TENSOR *input_tensors, *output_tensors;
+  int32_t input_num, output_num;
+  ret = CVI_NN_GetInputOutputTensors(g_model_handle, &input_tensors, &input_num,
+                                     &output_tensors, &output_num);
+  assert(ret == CVI_RC_SUCCESS);
+  for (int seed = 0; seed < g_seed_num; seed++) {
+    std::mt19937 gen{(uint32_t)seed};
+    fill_inputs(input_tensors, input_num, gen);
+    ret = CVI_NN_Forward(g_model_handle, input_tensors, input_num,
+                         output_tensors, output_num);
+    TPU_ASSERT(ret == CVI_RC_SUCCESS, nullptr);
+    std::vector<std::vector<uint8_t>> outputs;
+    for (int i = 0; i < output_num; i++) {
+      auto ptr = (uint8_t *)CVI_NN_TensorPtr(&output_tensors[i]);
+      outputs.emplace_back(ptr, ptr + CVI_NN_TensorSize(&output_tensors[i]));
+    }
+    g_ref_outputs.push_back(outputs);
+  }
+}
+
+static void check_outputs(CVI_TENSOR *output_tensors, int32_t output_num, int seed) {
+  auto &refs = g_ref_outputs[seed];
+  for (int i = 0; i < output_num; i++) {
+    auto ptr = (uint8_t *)CVI_NN_TensorPtr(&output_tensors[i]);
+    if (memcmp(ptr, refs[i].data(), refs[i].size())) {
+      printf("output %s mismatch, seed:%d\n", output_tensors[i].name, seed);
+      g_mismatch_cnt++;
+    }
+  }
+}
 
 
 static void *thread_entry(void *p) {
@@ -48,37 +115,20 @@ static void *thread_entry(void *p) {
   assert(ret == CVI_RC_SUCCESS);
 
   int32_t count = g_infer_cnt;
+  std::random_device rd{};
   while (count--) {
     // fill random data to inputs.
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-    for (int i = 0; i < input_num; i++) {
-      CVI_TENSOR *tensor = &input_tensors[i];
-      if (tensor->fmt == CVI_FMT_FP32) {
-        std::normal_distribution<float> d{0.3, 0.2};
-        float *data = (float *)CVI_NN_TensorPtr(tensor);
-        for (int i = 0; i < (int)CVI_NN_TensorCount(tensor); i++) {
-          float rand = d(gen);
-          rand = rand < 0 ? 0 : rand;
-          rand = rand > 1 ? 1 : rand;
-          data[i] = rand;
-        }
-      } else {
-        std::normal_distribution<float> d{50, 50};
-        int8_t *data = (int8_t *)CVI_NN_TensorPtr(tensor);
-        for (int i = 0; i < (int)CVI_NN_TensorCount(tensor); i++) {
-          float rand = std::round(d(gen));
-          rand = rand < 0 ? 0 : rand;
-          rand = rand > 127 ? 127 : rand;
-          data[i] = (int8_t)rand;
-        }
-      }
-    }
+    int seed = count % g_seed_num;
+    std::mt19937 gen{g_exact ? (uint32_t)seed : rd()};
+    fill_inputs(input_tensors, input_num, gen);
 
     CVI_RC rc =
         CVI_NN_Forward(model, input_tensors, input_num,
                        output_tensors, output_num);
     TPU_ASSERT(rc == CVI_RC_SUCCESS, nullptr);
+    if (g_exact) {
+      check_outputs(output_tensors, output_num, seed);
+    }
   }
 
   CVI_NN_CleanupModel(model);
@@ -93,11 +143,16 @@ int main(int argc, const char **argv) {
   parser.addArgument("-n", "--threads", 1, false); // thread count
   parser.addArgument("-c", "--count", 1, false); // inference count
   parser.addArgument("-v", "--verbose", 1);
+  parser.addArgument("-e", "--exact"); // check outputs are bit-exact
   parser.parse(argc, argv);
 
   int thread_num = parser.retrieve<int>("threads");
   g_model_file = parser.retrieve<std::string>("model");
   g_infer_cnt = parser.retrieve<int>("count");
+  if (parser.gotArgument("exact")) {
+    g_exact = true;
+    generate_references();
+  }
 
   pthread_t *thread = new pthread_t[thread_num];
   for (int i = 0; i < thread_num; i++) {
@@ -117,5 +172,13 @@ int main(int argc, const char **argv) {
   }
   delete[] thread;
 
+  if (g_exact) {
+    CVI_NN_CleanupModel(g_model_handle);
+    if (g_mismatch_cnt) {
+      printf("%d outputs mismatch\n", (int)g_mismatch_cnt);
+      return 1;
+    }
+    printf("all outputs are bit-exact\n");
+  }
   return 0;
 }
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <iostream>
+#include <sys/time.h>
+#include <cviruntime_context.h>
+#include <runtime/debug.h>
+#include "cviruntime.h"
+#include <runtime/version.h>
+#include "argparse.hpp"
+#include "assert.h"
+
+#define EXIT_IF_ERROR(cond, statement)       \
+  if ((cond)) {                              \
+    printf("%s\n", statement);               \
+    exit(1);                                 \
+  }
+
+static std::vector<std::string> optModelFiles;
+static int32_t optCopies = 1;
+static int32_t optRounds = 3;
+
+static long elapsedUs(struct timeval &t0, struct timeval &t1) {
+  return (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec;
+}
+
+static void cleanupModels(std::vector<CVI_MODEL_HANDLE> &models) {
+  for (auto model : models) {
+    CVI_NN_CleanupModel(model);
+  }
+}
+
+// register all models one by one on current thread
+static long registerSerial(std::vector<std::string> &files) {
+  std::vector<CVI_MODEL_HANDLE> models(files.size());
+  struct timeval t0, t1;
+  gettimeofday(&t0, NULL);
+  for (size_t i = 0; i < files.size(); ++i) {
+    CVI_RC ret = CVI_NN_RegisterModel(files[i].c_str(), &models[i]);
+    EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to register cvimodel");
+  }
+  gettimeofday(&t1, NULL);
+  cleanupModels(models);
+  return elapsedUs(t0, t1);
+}
+
+// register each model on its own thread
+static long registerThreaded(std::vector<std::string> &files) {
+  std::vector<CVI_MODEL_HANDLE> models(files.size());
+  std::vector<std::thread> threads;
+  struct timeval t0, t1;
+  gettimeofday(&t0, NULL);
+  for (size_t i = 0; i < files.size(); ++i) {
+    threads.emplace_back([&files, &models, i]() {
+      CVI_RC ret = CVI_NN_RegisterModel(files[i].c_str(), &models[i]);
+      EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to register cvimodel");
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  gettimeofday(&t1, NULL);
+  cleanupModels(models);
+  return elapsedUs(t0, t1);
+}
+
+// register all models by async api, then wait for them
+static long registerAsync(std::vector<std::string> &files) {
+  std::vector<CVI_MODEL_HANDLE> models(files.size());
+  std::vector<CVI_REGISTER_HANDLE> handles(files.size());
+  struct timeval t0, t1;
+  gettimeofday(&t0, NULL);
+  for (size_t i = 0; i < files.size(); ++i) {
+    CVI_RC ret = CVI_NN_RegisterModelAsync(files[i].c_str(), &handles[i]);
+    EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to register cvimodel");
+  }
+  for (size_t i = 0; i < files.size(); ++i) {
+    CVI_RC ret = CVI_NN_RegisterModelWait(handles[i], &models[i]);
+    EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to register cvimodel");
+  }
+  gettimeofday(&t1, NULL);
+  cleanupModels(models);
+  return elapsedUs(t0, t1);
+}
+
+static void report(const char *name, std::vector<long> &elapsed, long base) {
+  long best = elapsed[0];
+  long sum = 0;
+  for (auto e : elapsed) {
+    best = std::min(best, e);
+    sum += e;
+  }
+  double avg = (double)sum / elapsed.size();
+  printf("  %-10s avg %10.3f ms, best %10.3f ms, speedup %.2fx\n", name,
+         avg / 1000.0, best / 1000.0, base ? (double)base / avg : 1.0);
+}
+
+int main(int argc, const char **argv) {
+  showRuntimeVersion();
+
+  argparse::ArgumentParser parser;
+  parser.addArgument("-m", "--models", '+', false); // required
+  parser.addArgument("-n", "--copies", 1); // copies of each model
+  parser.addArgument("-r", "--rounds", 1);
+  parser.parse(argc, argv);
+
+  optModelFiles = parser.retrieve<std::vector<std::string>>("models");
+  if (parser.gotArgument("copies")) {
+    optCopies = parser.retrieve<int>("copies");
+  }
+  if (parser.gotArgument("rounds")) {
+    optRounds = parser.retrieve<int>("rounds");
+  }
+  // every registration should load its own copy
+  setenv("TPU_DISABLE_MODEL_CACHE", "1", 1);
+  // async registration takes no flags, so all modes keep the default
+  // lazy loading to be comparable.
+  printf("lazy loading is on, cmdbuf of models with several programs "
+         "is loaded when a program is selected, not counted here\n");
+
+  std::vector<std::string> files;
+  for (int i = 0; i < optCopies; ++i) {
+    files.insert(files.end(), optModelFiles.begin(), optModelFiles.end());
+  }
+
+  // keep the global context alive across rounds, so its creation
+  // is not counted.
+  CVI_MODEL_HANDLE holder = nullptr;
+  CVI_RC ret = CVI_NN_RegisterModel(files[0].c_str(), &holder);
+  EXIT_IF_ERROR(ret != CVI_RC_SUCCESS, "failed to register cvimodel");
+
+  std::vector<long> serial, threaded, async;
+  for (int i = 0; i < optRounds; ++i) {
+    serial.push_back(registerSerial(files));
+    threaded.push_back(registerThreaded(files));
+    async.push_back(registerAsync(files));
+  }
+  CVI_NN_CleanupModel(holder);
+
+  long base = 0;
+  for (auto e : serial) {
+    base += e;
+  }
+  base /= optRounds;
+  printf("Register %zu models, %d rounds:\n", files.size(), optRounds);
+  report("serial", serial, base);
+  report("threaded", threaded, base);
+  report("async", async, base);
+  return 0;
+}